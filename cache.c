@@ -25,6 +25,7 @@
 #include "cache.h"
 
 #include "fs.h"
+#include "nonstd.h"
 
 #include <stdlib.h>
 
@@ -34,6 +35,7 @@ sqfs_err sqfs_cache_init(sqfs_cache *cache, size_t size, size_t count,
 	cache->count = count;
 	cache->dispose = dispose;
 	cache->next = 0;
+	cache->hits = cache->misses = cache->evictions = 0;
 	
 	cache->idxs = calloc(count, sizeof(sqfs_cache_idx));
 	cache->buf = calloc(count, size);
@@ -63,9 +65,12 @@ void sqfs_cache_destroy(sqfs_cache *cache) {
 void *sqfs_cache_get(sqfs_cache *cache, sqfs_cache_idx idx) {
 	size_t i;
 	for (i = 0; i < cache->count; ++i) {
-		if (cache->idxs[i] == idx)
+		if (cache->idxs[i] == idx) {
+			++cache->hits;
 			return sqfs_cache_entry(cache, i);
+		}
 	}
+	++cache->misses;
 	return NULL;
 }
 
@@ -73,8 +78,10 @@ void *sqfs_cache_add(sqfs_cache *cache, sqfs_cache_idx idx) {
 	size_t i = (cache->next++);
 	cache->next %= cache->count;
 	
-	if (cache->idxs[i] != SQFS_CACHE_IDX_INVALID)
+	if (cache->idxs[i] != SQFS_CACHE_IDX_INVALID) {
 		cache->dispose(sqfs_cache_entry(cache, i));
+		++cache->evictions;
+	}
 	
 	cache->idxs[i] = idx;
 	return sqfs_cache_entry(cache, i);
@@ -104,3 +111,34 @@ sqfs_err sqfs_block_cache_init(sqfs_cache *cache, size_t count) {
 	return sqfs_cache_init(cache, sizeof(sqfs_block_cache_entry), count,
 		&sqfs_block_cache_dispose);
 }
+
+
+void sqfs_raw_cache_destroy(sqfs_raw_cache *raw) {
+	free(raw->data);
+	raw->data = NULL;
+	raw->size = raw->cap = 0;
+}
+
+void *sqfs_raw_cache_get(sqfs_raw_cache *raw, sqfs_off_t pos, size_t size) {
+	if (pos < raw->pos || pos + size > raw->pos + raw->size)
+		return NULL;
+	return raw->data + (pos - raw->pos);
+}
+
+sqfs_err sqfs_raw_cache_read(sqfs *fs, sqfs_raw_cache *raw, sqfs_off_t pos,
+		size_t size) {
+	if (size > raw->cap) {
+		char *data = realloc(raw->data, size);
+		if (!data)
+			return SQFS_ERR;
+		raw->data = data;
+		raw->cap = size;
+	}
+	
+	raw->size = 0;
+	if (sqfs_pread(fs, raw->data, size, pos) != (ssize_t)size)
+		return SQFS_ERR;
+	raw->pos = pos;
+	raw->size = size;
+	return SQFS_OK;
+}
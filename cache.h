@@ -46,6 +46,8 @@ typedef struct {
 	
 	size_t size, count;
 	size_t next; /* next block to evict */
+	
+	uint64_t hits, misses, evictions; /* see stats.h */
 } sqfs_cache;
 
 sqfs_err sqfs_cache_init(sqfs_cache *cache, size_t size, size_t count,
@@ -64,4 +66,22 @@ typedef struct {
 
 sqfs_err sqfs_block_cache_init(sqfs_cache *cache, size_t count);
 
+
+/* A single run of raw, still-compressed bytes read from disk ahead of
+ * decoding. Lets us read many adjacent blocks with one I/O. */
+typedef struct {
+	sqfs_off_t pos;
+	size_t size, cap;
+	char *data;
+} sqfs_raw_cache;
+
+void sqfs_raw_cache_destroy(sqfs_raw_cache *raw);
+
+/* Get the bytes at [pos, pos + size), or NULL if they're not held */
+void *sqfs_raw_cache_get(sqfs_raw_cache *raw, sqfs_off_t pos, size_t size);
+
+/* Replace the contents with 'size' bytes read from 'pos' */
+sqfs_err sqfs_raw_cache_read(sqfs *fs, sqfs_raw_cache *raw, sqfs_off_t pos,
+	size_t size);
+
 #endif
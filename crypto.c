@@ -97,6 +97,14 @@ sqfs_err crypt_init_key(sqfs *fs, const char *key) {
         return 0;
 }
 
+sqfs_err crypt_clone(sqfs *fs, sqfs *orig) {
+        struct crypto *crypto = malloc(sizeof(struct crypto));
+        if (!crypto) return SQFS_ERR;
+        memcpy(crypto, orig->crypto, sizeof(struct crypto));
+        fs->crypto = crypto;
+        return SQFS_OK;
+}
+
 void crypt_decrypt(sqfs *fs, void *buf, size_t count, sqfs_off_t off) {
         /* Increment Iv and handle overflow */
         struct crypto *crypto = (struct crypto*)fs->crypto;
@@ -1,3 +1,5 @@
 #include "fs.h"
 sqfs_err crypt_init_key(sqfs *fs, const char *key);
+/* Copy the key of another handle on the same image */
+sqfs_err crypt_clone(sqfs *fs, sqfs *orig);
 void crypt_decrypt(sqfs *fs, void *buf, size_t count, sqfs_off_t off);
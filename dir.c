@@ -27,6 +27,7 @@
 #include "fs.h"
 #include "swap.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
@@ -159,6 +160,87 @@ bool sqfs_dir_next(sqfs *fs, sqfs_dir *dir, sqfs_dir_entry *entry,
 	return true;
 }
 
+sqfs_err sqfs_dir_listing_open(sqfs *fs, sqfs_inode *inode,
+		sqfs_dir_listing *listing) {
+	sqfs_md_cursor cur;
+	sqfs_err err;
+	
+	if (!S_ISDIR(inode->base.mode))
+		return SQFS_ERR;
+	
+	memset(listing, 0, sizeof(*listing));
+	listing->size = inode->xtra.dir.dir_size <= 3 ? 0 :
+		inode->xtra.dir.dir_size - 3;
+	if (listing->size == 0)
+		return SQFS_OK;
+	
+	cur.block = inode->xtra.dir.start_block + fs->sb.directory_table_start;
+	cur.offset = inode->xtra.dir.offset;
+	if ((listing->data = sqfs_md_ref(fs, &cur, listing->size)))
+		return SQFS_OK;
+	
+	if (!(listing->buf = malloc(listing->size)))
+		return SQFS_ERR;
+	if ((err = sqfs_md_read(fs, &cur, listing->buf, listing->size))) {
+		sqfs_dir_listing_close(listing);
+		return err;
+	}
+	listing->data = listing->buf;
+	return SQFS_OK;
+}
+
+void sqfs_dir_listing_close(sqfs_dir_listing *listing) {
+	free(listing->buf);
+	memset(listing, 0, sizeof(*listing));
+}
+
+bool sqfs_dir_listing_next(sqfs_dir_listing *listing, sqfs_dir_entry *entry,
+		const char **name, sqfs_err *err) {
+	struct squashfs_dir_entry e;
+	
+	*err = SQFS_OK;
+	entry->offset = listing->offset;
+	
+	while (listing->header.count == 0) {
+		if (listing->offset >= listing->size)
+			return false;
+		
+		if (listing->offset + sizeof(listing->header) > listing->size)
+			goto error;
+		memcpy(&listing->header, listing->data + listing->offset,
+			sizeof(listing->header));
+		listing->offset += sizeof(listing->header);
+		sqfs_swapin_dir_header(&listing->header);
+		++(listing->header.count); /* biased by one */
+	}
+	
+	if (listing->offset + sizeof(e) > listing->size)
+		goto error;
+	memcpy(&e, listing->data + listing->offset, sizeof(e));
+	listing->offset += sizeof(e);
+	sqfs_swapin_dir_entry(&e);
+	--(listing->header.count);
+	
+	entry->type = e.type;
+	entry->name_size = e.size + 1;
+	entry->inode = ((uint64_t)listing->header.start_block << 16) + e.offset;
+	/* e.inode_number is signed */
+	entry->inode_number = listing->header.inode_number +
+		(int16_t)e.inode_number;
+	
+	if (listing->offset + entry->name_size > listing->size)
+		goto error;
+	*name = listing->data + listing->offset;
+	listing->offset += entry->name_size;
+	
+	entry->next_offset = listing->offset;
+	return true;
+
+error:
+	*err = SQFS_ERR;
+	return false;
+}
+
 
 static sqfs_err sqfs_dir_ff_header(sqfs *fs, sqfs_inode *inode,
 		sqfs_dir *dir, sqfs_dir_header_f func, void *arg) {
@@ -49,6 +49,15 @@ typedef struct {
 
 typedef char sqfs_name[SQUASHFS_NAME_LEN + 1];
 
+/* A whole directory listing in memory, so its entries can be iterated without
+   going back to the metadata cache for each one */
+typedef struct {
+	const char *data;
+	char *buf;		/* Our own copy of the listing, if we needed one */
+	size_t size, offset;
+	struct squashfs_dir_header header;
+} sqfs_dir_listing;
+
 /* Begin a directory traversal, initializing the dir structure.
    If offset is non-zero, fast-forward to that offset in the directory. */
 sqfs_err 	sqfs_dir_open(sqfs *fs, sqfs_inode *inode, sqfs_dir *dir,
@@ -65,6 +74,18 @@ void sqfs_dentry_init(sqfs_dir_entry *entry, char *namebuf);
 bool sqfs_dir_next(sqfs *fs, sqfs_dir *dir, sqfs_dir_entry *entry,
 	sqfs_err *err);
 
+/* Get a directory's entire listing. If the metadata arena is loaded, this
+   points straight into it, otherwise the listing is copied once. */
+sqfs_err sqfs_dir_listing_open(sqfs *fs, sqfs_inode *inode,
+	sqfs_dir_listing *listing);
+void sqfs_dir_listing_close(sqfs_dir_listing *listing);
+
+/* Like sqfs_dir_next, but never copies the name. Instead 'name' is pointed at
+	 the name inside the listing, which is NOT nul-terminated, and stays valid
+	 until the listing is closed. The entry's own name buffer is untouched. */
+bool sqfs_dir_listing_next(sqfs_dir_listing *listing, sqfs_dir_entry *entry,
+	const char **name, sqfs_err *err);
+
 /* Lookup an entry in a directory inode.
 	 The dir_entry must have been initialized with a buffer. */
 sqfs_err sqfs_dir_lookup(sqfs *fs, sqfs_inode *inode,
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "diskcache.h"
+
+#include "fs.h"
+#include "nonstd.h"
+#include "util.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+/* When evicting, shrink to this fraction of the maximum size */
+#define DISK_CACHE_LOW_WATER(max) ((max) / 10 * 9)
+
+/* Longest file name we create in the cache directory */
+#define DISK_CACHE_NAME_MAX 64
+
+typedef struct {
+	char *dir;
+	uint64_t max_size;
+	uint64_t size;		/* Approximate, other processes may add blocks too */
+} sqfs_disk_cache;
+
+/* Start of each file in the cache */
+typedef struct {
+	uint64_t sum;		/* sqfs_content_hash of the block's on-disk bytes */
+	uint64_t check;		/* sqfs_content_hash of the data that follows */
+	uint32_t size;		/* Size of the data */
+	uint32_t pad;
+} sqfs_disk_cache_header;
+
+typedef struct {
+	time_t mtime;
+	off_t size;
+	char name[DISK_CACHE_NAME_MAX];
+} sqfs_disk_cache_file;
+
+static bool sqfs_disk_cache_is_block(const char *name) {
+	return name[0] != '.';
+}
+
+static char *sqfs_disk_cache_path(sqfs_disk_cache *dc, const char *name) {
+	size_t size = strlen(dc->dir) + 1 + strlen(name) + 1;
+	char *path = malloc(size);
+	if (path)
+		snprintf(path, size, "%s/%s", dc->dir, name);
+	return path;
+}
+
+static int sqfs_disk_cache_file_cmp(const void *a, const void *b) {
+	const sqfs_disk_cache_file *fa = a, *fb = b;
+	if (fa->mtime != fb->mtime)
+		return fa->mtime < fb->mtime ? -1 : 1;
+	return 0;
+}
+
+/* Scan the cache directory, recomputing its size. If 'evict' is set, remove
+ * the oldest blocks until we're below the low-water mark. */
+static sqfs_err sqfs_disk_cache_scan(sqfs_disk_cache *dc, bool evict) {
+	DIR *d;
+	struct dirent *de;
+	sqfs_disk_cache_file *files = NULL;
+	size_t count = 0, cap = 0, i;
+	uint64_t low = DISK_CACHE_LOW_WATER(dc->max_size);
+
+	if (!(d = opendir(dc->dir)))
+		return SQFS_ERR;
+
+	dc->size = 0;
+	while ((de = readdir(d))) {
+		struct stat st;
+		char *path;
+
+		if (!sqfs_disk_cache_is_block(de->d_name)
+				|| strlen(de->d_name) >= DISK_CACHE_NAME_MAX)
+			continue;
+		if (!(path = sqfs_disk_cache_path(dc, de->d_name)))
+			continue;
+		if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+			dc->size += st.st_size;
+			if (evict) {
+				if (count == cap) {
+					size_t ncap = cap ? cap * 2 : 256;
+					sqfs_disk_cache_file *nfiles = realloc(files,
+						ncap * sizeof(*files));
+					if (!nfiles) {
+						free(path);
+						break;
+					}
+					files = nfiles;
+					cap = ncap;
+				}
+				files[count].mtime = st.st_mtime;
+				files[count].size = st.st_size;
+				strcpy(files[count].name, de->d_name);
+				++count;
+			}
+		}
+		free(path);
+	}
+	closedir(d);
+
+	if (evict) {
+		qsort(files, count, sizeof(*files), sqfs_disk_cache_file_cmp);
+		for (i = 0; i < count && dc->size > low; ++i) {
+			char *path = sqfs_disk_cache_path(dc, files[i].name);
+			if (path && unlink(path) == 0)
+				dc->size -= files[i].size;
+			free(path);
+		}
+	}
+	free(files);
+	return SQFS_OK;
+}
+
+sqfs_err sqfs_disk_cache_init(sqfs *fs, const char *dir, uint64_t max_size) {
+	sqfs_disk_cache *dc;
+	uint64_t id;
+	char *abs;
+
+	if (fs->crypto) /* Never write decrypted data to disk */
+		return SQFS_UNSUP;
+
+	if (sqfs_image_id(fs, &id))
+		return SQFS_ERR;
+
+	/* Daemonizing will change to the root directory */
+	if (!(abs = sqfs_abs_path(dir)))
+		return SQFS_ERR;
+	if (!(dc = malloc(sizeof(*dc)))) {
+		free(abs);
+		return SQFS_ERR;
+	}
+	dc->max_size = max_size;
+	dc->size = 0;
+	if (!(dc->dir = malloc(strlen(abs) + 1 + 16 + 1))) {
+		free(abs);
+		free(dc);
+		return SQFS_ERR;
+	}
+	sprintf(dc->dir, "%s/%016llx", abs, (unsigned long long)id);
+
+	if ((mkdir(abs, 0755) == -1 && errno != EEXIST)
+			|| (mkdir(dc->dir, 0755) == -1 && errno != EEXIST)
+			|| sqfs_disk_cache_scan(dc, false)) {
+		free(abs);
+		free(dc->dir);
+		free(dc);
+		return SQFS_ERR;
+	}
+	free(abs);
+	if (dc->size > dc->max_size)
+		sqfs_disk_cache_scan(dc, true);
+
+	fs->disk_cache = dc;
+	return SQFS_OK;
+}
+
+void sqfs_disk_cache_destroy(sqfs *fs) {
+	sqfs_disk_cache *dc = fs->disk_cache;
+	if (!dc)
+		return;
+	free(dc->dir);
+	free(dc);
+	fs->disk_cache = NULL;
+}
+
+static bool sqfs_disk_cache_read_all(int fd, void *buf, size_t size) {
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = read(fd, (char*)buf + done, size - done);
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+static bool sqfs_disk_cache_write_all(int fd, const void *buf, size_t size) {
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = write(fd, (const char*)buf + done, size - done);
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+sqfs_err sqfs_disk_cache_get(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+		sqfs_block **block) {
+	sqfs_disk_cache *dc = fs->disk_cache;
+	sqfs_disk_cache_header hdr;
+	char name[DISK_CACHE_NAME_MAX], *path;
+	struct stat st;
+	int fd;
+
+	if (!dc)
+		return SQFS_ERR;
+
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)pos);
+	if (!(path = sqfs_disk_cache_path(dc, name)))
+		return SQFS_ERR;
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		free(path);
+		return SQFS_ERR;
+	}
+
+	/* Only trust a file that's complete, and is for these on-disk bytes */
+	*block = NULL;
+	if (fstat(fd, &st) == 0
+			&& sqfs_disk_cache_read_all(fd, &hdr, sizeof(hdr))
+			&& hdr.sum == sum && hdr.size > 0
+			&& hdr.size <= fs->sb.block_size
+			&& st.st_size == (off_t)(sizeof(hdr) + hdr.size)
+			&& (*block = malloc(sizeof(**block)))) {
+		(*block)->size = hdr.size;
+		if (!((*block)->data = malloc(hdr.size))
+				|| !sqfs_disk_cache_read_all(fd, (*block)->data, hdr.size)
+				|| sqfs_content_hash(SQFS_CONTENT_HASH_INIT, (*block)->data,
+					hdr.size) != hdr.check) {
+			sqfs_block_dispose(*block);
+			*block = NULL;
+		}
+	}
+	close(fd);
+
+	if (*block)
+		utime(path, NULL); /* Mark it recently used */
+	free(path);
+	return *block ? SQFS_OK : SQFS_ERR;
+}
+
+void sqfs_disk_cache_put(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+		sqfs_block *block) {
+	sqfs_disk_cache *dc = fs->disk_cache;
+	sqfs_disk_cache_header hdr;
+	char name[DISK_CACHE_NAME_MAX], *path, *tmp;
+	uint64_t replaced = 0;
+	bool written;
+	struct stat st;
+	int fd;
+
+	if (!dc || block->size == 0)
+		return;
+
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)pos);
+	path = sqfs_disk_cache_path(dc, name);
+	snprintf(name, sizeof(name), ".%016llx.%ld", (unsigned long long)pos,
+		(long)getpid());
+	tmp = sqfs_disk_cache_path(dc, name);
+	if (!path || !tmp)
+		goto done;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.sum = sum;
+	hdr.check = sqfs_content_hash(SQFS_CONTENT_HASH_INIT, block->data,
+		block->size);
+	hdr.size = block->size;
+
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+		goto done;
+	written = sqfs_disk_cache_write_all(fd, &hdr, sizeof(hdr))
+		&& sqfs_disk_cache_write_all(fd, block->data, block->size);
+	/* Another mount may have stored this block already */
+	if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+		replaced = st.st_size;
+	if (close(fd) == 0 && written && rename(tmp, path) == 0) {
+		dc->size += sizeof(hdr) + block->size;
+		dc->size = dc->size > replaced ? dc->size - replaced : 0;
+		if (dc->size > dc->max_size)
+			sqfs_disk_cache_scan(dc, true);
+	} else {
+		unlink(tmp);
+	}
+
+done:
+	free(path);
+	free(tmp);
+}
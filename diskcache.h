@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SQFS_DISKCACHE_H
+#define SQFS_DISKCACHE_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+/* Persistent cache of decompressed data blocks, kept in a local directory
+ * so that restarts and other mounts of the same image can skip
+ * decompression.
+ *
+ * Implementation
+ *	- One subdirectory per image, named by a hash of the image's superblock
+ *	  and first inode metadata
+ *	- One file per block, named by the block's position in the image. It
+ *	  starts with a header holding hashes of the block's on-disk bytes and
+ *	  of the decompressed data, so a file left by another image or damaged
+ *	  on disk is never returned.
+ *	- Blocks are written to a temporary name and renamed into place, so
+ *	  concurrent mounts never see a partial block
+ *	- A hit refreshes the file's mtime; when the cache grows past its size
+ *	  bound, the files with the oldest mtimes are removed
+ */
+
+/* Start using a disk cache in 'dir', bounded to roughly max_size bytes */
+sqfs_err sqfs_disk_cache_init(sqfs *fs, const char *dir, uint64_t max_size);
+void sqfs_disk_cache_destroy(sqfs *fs);
+
+/* Get a decompressed data block, whose on-disk bytes have the
+ * sqfs_content_hash 'sum'. Fails if the cache is disabled, or doesn't have the
+ * block. */
+sqfs_err sqfs_disk_cache_get(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+	sqfs_block **block);
+
+/* Store a decompressed data block. Best effort, errors are ignored. */
+void sqfs_disk_cache_put(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+	sqfs_block *block);
+
+#endif
@@ -1,8 +1,12 @@
+#define _GNU_SOURCE
+#define _DARWIN_C_SOURCE
+#include "hash.h"
 #include "nonstd.h"
 #include "squashfs_fs.h"
 #include "squashfuse.h"
 #include "stat.h"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,6 +14,15 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
+#if defined(HAVE_SYS_XATTR_H) && defined(HAVE_LSETXATTR)
+#include <sys/xattr.h>
+#define RESTORE_XATTRS 1
+#endif
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 
 #define PROGNAME "squashfuse_extract"
 
@@ -17,9 +30,17 @@
 #define ERR_USAGE	(2)
 #define ERR_OPEN	(3)
 
+/* Large files are split into pieces of about this size, so several threads
+ * can work on them at once */
+#define PIECE_SIZE (1024 * 1024)
+/* Maximum number of runs of pieces waiting for a thread */
+#define QUEUE_SIZE 64
+
 static void usage() {
-    fprintf(stderr, "Usage: %s ARCHIVE PATH_TO_EXTRACT\n", PROGNAME);
-    fprintf(stderr, "       %s ARCHIVE -a\n", PROGNAME);
+    fprintf(stderr, "Usage: %s [-d] [-j THREADS] ARCHIVE PATH_TO_EXTRACT\n",
+        PROGNAME);
+    fprintf(stderr, "       %s [-d] [-j THREADS] ARCHIVE -a\n", PROGNAME);
+    fprintf(stderr, "  -d  write file data in the order it's stored in the image\n");
     exit(ERR_USAGE);
 }
 
@@ -28,6 +49,496 @@ static void die(const char *msg) {
     exit(ERR_MISC);
 }
 
+/* A range of a regular file, to be written by one thread */
+typedef struct extract_piece extract_piece;
+
+/* A regular file being extracted */
+typedef struct {
+    char *path;
+    sqfs_inode_id inode;
+    size_t pieces;          /* Pieces not yet written */
+    extract_piece *owned;   /* Pieces to free along with the file, if any */
+} extract_file;
+
+struct extract_piece {
+    extract_file *file;
+    sqfs_off_t start;
+    sqfs_off_t size;
+    uint64_t order;     /* Where the data is in the image */
+    bool fragment;      /* Just the tail end, stored in a fragment */
+};
+
+/* Pieces that one thread writes in a row */
+typedef struct {
+    extract_piece *pieces;
+    size_t count;
+} extract_run;
+
+/* With -d, all the pieces are collected here, then sorted into disk order */
+static struct {
+    extract_piece *pieces;
+    size_t count, cap;
+} pending;
+static bool disk_order;
+
+/* Everything we've created, so we can set ownership, permissions, xattrs and
+ * times once all the data is written */
+typedef struct {
+    char *path;
+    sqfs_inode_id inode;
+} extract_meta;
+
+static struct {
+    extract_meta *entries;
+    size_t count, cap;
+} metas;
+
+/* Index in metas of the first path extracted for each hard-linked inode */
+static sqfs_hash hardlinks;
+
+/* Each thread has its own filesystem, since the caches aren't thread-safe */
+typedef struct {
+    sqfs fs;
+    char *buf;
+    bool no_copy_range; /* copy_file_range doesn't work here */
+#ifdef HAVE_PTHREAD
+    pthread_t thread;
+#endif
+} extract_worker;
+
+#ifdef HAVE_PTHREAD
+static struct {
+    extract_run runs[QUEUE_SIZE];
+    size_t head, count;
+    bool done;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+} queue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full = PTHREAD_COND_INITIALIZER,
+};
+#endif
+
+static void write_all(int fd, const char *buf, size_t size, off_t off) {
+    while (size > 0) {
+        ssize_t n = pwrite(fd, buf, size, off);
+        if (n <= 0)
+            die("pwrite error");
+        buf += n;
+        off += n;
+        size -= n;
+    }
+}
+
+/* Called once each piece of a file is written */
+static void file_piece_done(extract_file *file) {
+    size_t left;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&queue.lock);
+#endif
+    left = --file->pieces;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&queue.lock);
+#endif
+    if (left == 0) {
+        free(file->path);
+        free(file->owned);
+        free(file);
+    }
+}
+
+/* Write the range [start, end) of a file, from decompressed data */
+static void extract_span(extract_worker *w, sqfs_inode *inode, int fd,
+        sqfs_off_t start, sqfs_off_t end) {
+    sqfs_off_t size = end - start;
+    if (size <= 0)
+        return;
+    if (sqfs_read_range(&w->fs, inode, start, &size, w->buf))
+        die("sqfs_read_range error");
+    write_all(fd, w->buf, size, start);
+}
+
+/* Can we copy this block straight from the image to the output? Then the
+ * kernel doesn't need to copy it through userspace, and may even share
+ * storage between the files. */
+static bool extract_copyable(extract_worker *w, sqfs_blocklist *bl) {
+#ifdef HAVE_COPY_FILE_RANGE
+    bool compressed;
+    uint32_t input_size;
+    sqfs_data_header(bl->header, &compressed, &input_size);
+    return !compressed && !w->fs.crypto && !w->no_copy_range;
+#else
+    return false;
+#endif
+}
+
+/* Returns false if the block must be written normally instead */
+static bool extract_copy(extract_worker *w, int fd, sqfs_blocklist *bl,
+        sqfs_off_t size) {
+#ifdef HAVE_COPY_FILE_RANGE
+    off_t in = w->fs.offset + bl->block, out = bl->pos;
+    while (size > 0) {
+        ssize_t n = copy_file_range(w->fs.fd, &in, fd, &out, size, 0);
+        if (n <= 0) {
+            /* Eg: old kernel, or an unsupported filesystem. Anything we
+             * did copy will just be written again. */
+            w->no_copy_range = true;
+            return false;
+        }
+        size -= n;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* Write a piece to its file. Holes in the image are left as holes. */
+static void extract_piece_write(extract_worker *w, extract_piece *piece) {
+    sqfs_inode inode;
+    sqfs_blocklist bl;
+    sqfs_off_t end = piece->start + piece->size;
+    sqfs_off_t span = piece->start; /* Start of data not yet written */
+    int fd;
+
+    if (sqfs_inode_get(&w->fs, &inode, piece->file->inode))
+        die("sqfs_inode_get error");
+    if ((fd = open(piece->file->path, O_WRONLY)) == -1)
+        die("open error");
+
+    if (!piece->fragment) {
+        /* Pieces start on a block boundary */
+        if (sqfs_blockidx_blocklist(&w->fs, &inode, &bl, piece->start))
+            die("sqfs_blockidx_blocklist error");
+        while (bl.remain > 0) {
+            sqfs_off_t pos, size;
+            if (sqfs_blocklist_next(&bl))
+                die("sqfs_blocklist_next error");
+            pos = bl.pos;
+            if (pos < piece->start)
+                continue;
+            if (pos >= end)
+                break;
+            
+            size = end - pos;
+            if (size > w->fs.sb.block_size)
+                size = w->fs.sb.block_size;
+            if (bl.input_size == 0) {
+                extract_span(w, &inode, fd, span, pos);
+                span = pos + size;
+            } else if (extract_copyable(w, &bl)) {
+                extract_span(w, &inode, fd, span, pos);
+                span = extract_copy(w, fd, &bl, size) ? pos + size : pos;
+            }
+        }
+    }
+    extract_span(w, &inode, fd, span, end);
+
+    close(fd);
+    file_piece_done(piece->file);
+}
+
+/* Pieces may be freed as they're written, so don't touch them afterwards */
+static void extract_run_write(extract_worker *w, extract_run *run) {
+    size_t i;
+    for (i = 0; i < run->count; ++i)
+        extract_piece_write(w, &run->pieces[i]);
+}
+
+#ifdef HAVE_PTHREAD
+static void *extract_thread(void *arg) {
+    extract_worker *w = arg;
+    extract_run run;
+
+    while (true) {
+        pthread_mutex_lock(&queue.lock);
+        while (queue.count == 0 && !queue.done)
+            pthread_cond_wait(&queue.not_empty, &queue.lock);
+        if (queue.count == 0) {
+            pthread_mutex_unlock(&queue.lock);
+            return NULL;
+        }
+        run = queue.runs[queue.head];
+        queue.head = (queue.head + 1) % QUEUE_SIZE;
+        --queue.count;
+        pthread_cond_signal(&queue.not_full);
+        pthread_mutex_unlock(&queue.lock);
+
+        extract_run_write(w, &run);
+    }
+}
+
+static extract_worker *workers;
+static size_t nworkers; /* Zero if we're extracting on the main thread */
+#endif
+
+static void workers_start(const char *image, size_t count, size_t buf_size) {
+#ifdef HAVE_PTHREAD
+    size_t i;
+    if (count <= 1)
+        return;
+    if (!(workers = calloc(count, sizeof(*workers))))
+        die("malloc error");
+    for (i = 0; i < count; ++i) {
+        if (sqfs_open_image(&workers[i].fs, image, 0))
+            exit(ERR_OPEN);
+        if (!(workers[i].buf = malloc(buf_size)))
+            die("malloc error");
+        if (pthread_create(&workers[i].thread, NULL, extract_thread,
+                &workers[i]))
+            die("pthread_create error");
+    }
+    nworkers = count;
+#endif
+}
+
+static void workers_finish() {
+#ifdef HAVE_PTHREAD
+    size_t i;
+    if (!nworkers)
+        return;
+    pthread_mutex_lock(&queue.lock);
+    queue.done = true;
+    pthread_cond_broadcast(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+    for (i = 0; i < nworkers; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        sqfs_destroy(&workers[i].fs);
+        sqfs_fd_close(workers[i].fs.fd);
+        free(workers[i].buf);
+    }
+    free(workers);
+#endif
+}
+
+/* Hand some pieces to a worker thread, or write them now if there are none */
+static void extract_run_add(extract_worker *self, extract_run *run) {
+#ifdef HAVE_PTHREAD
+    if (nworkers) {
+        pthread_mutex_lock(&queue.lock);
+        while (queue.count == QUEUE_SIZE)
+            pthread_cond_wait(&queue.not_full, &queue.lock);
+        queue.runs[(queue.head + queue.count) % QUEUE_SIZE] = *run;
+        ++queue.count;
+        pthread_cond_signal(&queue.not_empty);
+        pthread_mutex_unlock(&queue.lock);
+        return;
+    }
+#endif
+    extract_run_write(self, run);
+}
+
+/* Make room for some more pieces */
+static extract_piece *extract_pieces_alloc(extract_file *file, size_t count) {
+    extract_piece *pieces;
+    if (!disk_order) {
+        if (!(pieces = malloc(count * sizeof(*pieces))))
+            die("malloc error");
+        file->owned = pieces;
+        return pieces;
+    }
+    
+    /* Nothing points into pending until it's complete, so it can move */
+    if (pending.count + count > pending.cap) {
+        size_t cap = pending.cap ? pending.cap * 2 : 1024;
+        while (cap < pending.count + count)
+            cap *= 2;
+        if (!(pieces = realloc(pending.pieces, cap * sizeof(*pieces))))
+            die("malloc error");
+        pending.pieces = pieces;
+        pending.cap = cap;
+    }
+    pieces = pending.pieces + pending.count;
+    pending.count += count;
+    file->owned = NULL;
+    return pieces;
+}
+
+static int extract_piece_cmp(const void *a, const void *b) {
+    const extract_piece *pa = a, *pb = b;
+    if (pa->order != pb->order)
+        return pa->order < pb->order ? -1 : 1;
+    if (pa->start != pb->start)
+        return pa->start < pb->start ? -1 : 1;
+    return 0;
+}
+
+/* Write out everything collected with -d, in the order it's stored. All the
+ * tail ends in a fragment go to one thread, so it's decompressed only once. */
+static void extract_pending(extract_worker *self) {
+    extract_run run;
+    size_t i;
+    
+    qsort(pending.pieces, pending.count, sizeof(*pending.pieces),
+        extract_piece_cmp);
+    for (i = 0; i < pending.count; i += run.count) {
+        run.pieces = &pending.pieces[i];
+        run.count = 1;
+        while (run.pieces[0].fragment && i + run.count < pending.count
+                && run.pieces[run.count].fragment
+                && run.pieces[run.count].order == run.pieces[0].order)
+            ++run.count;
+        extract_run_add(self, &run);
+    }
+}
+
+/* Create a regular file, and queue up its contents to be written */
+static void extract_file_add(extract_worker *self, const char *path,
+        sqfs_inode_id id, sqfs_inode *inode, size_t piece_size) {
+    extract_file *file;
+    extract_piece *pieces;
+    extract_run run;
+    struct squashfs_fragment_entry frag;
+    sqfs_off_t file_size = inode->xtra.reg.file_size, blocks_size, start;
+    size_t count, i;
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+        die("open error");
+    if (ftruncate(fd, file_size) == -1)
+        die("ftruncate error");
+    close(fd);
+    if (file_size == 0)
+        return;
+
+    if (!(file = malloc(sizeof(*file)))
+            || !(file->path = malloc(strlen(path) + 1)))
+        die("malloc error");
+    strcpy(file->path, path);
+    file->inode = id;
+
+    /* The tail end in a fragment gets a piece of its own */
+    blocks_size = file_size;
+    if (inode->xtra.reg.frag_idx != SQUASHFS_INVALID_FRAG) {
+        blocks_size -= file_size % self->fs.sb.block_size;
+        if (sqfs_frag_entry(&self->fs, &frag, inode->xtra.reg.frag_idx))
+            die("sqfs_frag_entry error");
+    }
+    count = (blocks_size + piece_size - 1) / piece_size;
+    if (blocks_size < file_size)
+        ++count;
+    file->pieces = count;
+    pieces = extract_pieces_alloc(file, count);
+
+    for (i = 0, start = 0; i < count; ++i, start += piece_size) {
+        pieces[i].file = file;
+        pieces[i].start = start;
+        if (start < blocks_size) {
+            pieces[i].size = blocks_size - start;
+            if (pieces[i].size > (sqfs_off_t)piece_size)
+                pieces[i].size = piece_size;
+            pieces[i].order = inode->xtra.reg.start_block;
+            pieces[i].fragment = false;
+        } else {
+            pieces[i].start = blocks_size;
+            pieces[i].size = file_size - blocks_size;
+            pieces[i].order = frag.start_block;
+            pieces[i].fragment = true;
+        }
+    }
+
+    if (!disk_order) {
+        for (i = 0; i < count; ++i) {
+            run.pieces = &pieces[i];
+            run.count = 1;
+            extract_run_add(self, &run);
+        }
+    }
+}
+
+/* Remember to restore metadata for this path later */
+static void extract_meta_add(const char *path, sqfs_inode_id id) {
+    extract_meta *m;
+    if (metas.count == metas.cap) {
+        size_t cap = metas.cap ? metas.cap * 2 : 1024;
+        if (!(m = realloc(metas.entries, cap * sizeof(*m))))
+            die("malloc error");
+        metas.entries = m;
+        metas.cap = cap;
+    }
+    m = &metas.entries[metas.count++];
+    if (!(m->path = malloc(strlen(path) + 1)))
+        die("malloc error");
+    strcpy(m->path, path);
+    m->inode = id;
+}
+
+#ifdef RESTORE_XATTRS
+static void extract_xattrs(sqfs *fs, sqfs_inode *inode, const char *path) {
+    sqfs_xattr x;
+    
+    if (sqfs_xattr_open(fs, inode, &x))
+        die("sqfs_xattr_open error");
+    while (x.remain) {
+        size_t name_size, value_size;
+        char *name, *value;
+        
+        if (sqfs_xattr_read(&x))
+            die("sqfs_xattr_read error");
+        name_size = sqfs_xattr_name_size(&x);
+        if (sqfs_xattr_value_size(&x, &value_size))
+            die("sqfs_xattr_value_size error");
+        if (!(name = malloc(name_size + 1)) || !(value = malloc(value_size + 1)))
+            die("malloc error");
+        if (sqfs_xattr_name(&x, name, true) || sqfs_xattr_value(&x, value))
+            die("sqfs_xattr_value error");
+        name[name_size] = '\0';
+        
+        /* Some namespaces need privileges, don't give up on the rest */
+        if (lsetxattr(path, name, value, value_size, 0) == -1)
+            fprintf(stderr, "Can't set xattr %s on %s: %s\n", name, path,
+                strerror(errno));
+        free(name);
+        free(value);
+    }
+}
+#endif
+
+/* Set ownership, permissions, xattrs and times on everything we created.
+ * Children come after their parents in metas, so go backwards to set
+ * directory times after their contents are done. */
+static void extract_metas(sqfs *fs) {
+    size_t i;
+    
+    for (i = metas.count; i-- > 0; ) {
+        extract_meta *m = &metas.entries[i];
+        sqfs_inode inode;
+        struct stat st;
+        struct timespec times[2];
+        
+        if (sqfs_inode_get(fs, &inode, m->inode))
+            die("sqfs_inode_get error");
+        if (sqfs_stat(fs, &inode, &st))
+            die("sqfs_stat error");
+        
+        if (geteuid() == 0 && lchown(m->path, st.st_uid, st.st_gid) == -1)
+            perror("lchown error");
+        /* After chown, which can clear setuid bits */
+        if (!S_ISLNK(st.st_mode) && chmod(m->path, st.st_mode & 07777) == -1)
+            perror("chmod error");
+#ifdef RESTORE_XATTRS
+        extract_xattrs(fs, &inode, m->path);
+#endif
+        times[0].tv_sec = times[1].tv_sec = st.st_mtime;
+        times[0].tv_nsec = times[1].tv_nsec = 0;
+        if (utimensat(AT_FDCWD, m->path, times, AT_SYMLINK_NOFOLLOW) == -1)
+            perror("utimensat error");
+        free(m->path);
+    }
+    free(metas.entries);
+}
+
+static size_t default_threads() {
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0)
+        return n;
+#endif
+    return 1;
+}
+
 static bool starts_with(const char *pre, const char *str)
 {
     size_t lenpre = strlen(pre),
@@ -38,12 +549,14 @@ static bool starts_with(const char *pre, const char *str)
 int main(int argc, char *argv[]) {
     sqfs_err err = SQFS_OK;
     sqfs_traverse trv;
-    sqfs fs;
+    extract_worker self;
+    sqfs *fs = &self.fs;
     char *image;
     char *path_to_extract;
     char *prefix;
     char prefixed_path_to_extract[1024];
     struct stat st;
+    size_t threads = default_threads(), piece_size;
     
     prefix = "squashfs-root/";
     
@@ -54,15 +567,45 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    /* Options come before the archive, since "-a" isn't one */
+    while (argc > 3 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-d") == 0) {
+            disk_order = true;
+        } else if (strcmp(argv[1], "-j") == 0 && argc > 4
+                && atoi(argv[2]) >= 1) {
+            threads = atoi(argv[2]);
+            --argc;
+            ++argv;
+        } else {
+            usage();
+        }
+        --argc;
+        ++argv;
+    }
     if (argc != 3)
         usage();
     image = argv[1];
     path_to_extract = argv[2];
     
-    if ((err = sqfs_open_image(&fs, image, 0)))
+    if ((err = sqfs_open_image(fs, image, 0)))
         exit(ERR_OPEN);
     
-    if ((err = sqfs_traverse_open(&trv, &fs, sqfs_inode_root(&fs))))
+    /* Whole blocks per piece, so threads don't decompress the same block */
+    piece_size = PIECE_SIZE / fs->sb.block_size * fs->sb.block_size;
+    if (piece_size < fs->sb.block_size)
+        piece_size = fs->sb.block_size;
+    if (!(self.buf = malloc(piece_size)))
+        die("malloc error");
+    self.no_copy_range = false;
+    workers_start(image, threads, piece_size);
+    if (sqfs_hash_init(&hardlinks, sizeof(size_t), 64))
+        die("sqfs_hash_init error");
+    
+    /* The root of the extraction gets the image root's metadata. First in
+     * metas, so it's done last. */
+    extract_meta_add(prefix, sqfs_inode_root(fs));
+    
+    if ((err = sqfs_traverse_open(&trv, fs, sqfs_inode_root(fs))))
         die("sqfs_traverse_open error");
     while (sqfs_traverse_next(&trv, &err)) {
         if (!trv.dir_end) {
@@ -70,13 +613,34 @@ int main(int argc, char *argv[]) {
                 fprintf(stderr, "trv.path: %s\n", trv.path);
                 fprintf(stderr, "sqfs_inode_id: %llu\n", (unsigned long long)trv.entry.inode);
                 sqfs_inode inode;
-                if (sqfs_inode_get(&fs, &inode, trv.entry.inode))
+                if (sqfs_inode_get(fs, &inode, trv.entry.inode))
                     die("sqfs_inode_get error");
                 fprintf(stderr, "inode.base.inode_type: %i\n", inode.base.inode_type);
                 fprintf(stderr, "inode.xtra.reg.file_size: %llu\n", (unsigned long long)inode.xtra.reg.file_size);
                 strcpy(prefixed_path_to_extract, "");
                 strcat(strcat(prefixed_path_to_extract, prefix), trv.path);
-                if (inode.base.inode_type == SQUASHFS_DIR_TYPE){
+                if (sqfs_stat(fs, &inode, &st) != 0)
+                    die("sqfs_stat error");
+                
+                if (!S_ISDIR(st.st_mode) && inode.nlink > 1) {
+                    void *found = sqfs_hash_get(&hardlinks,
+                        inode.base.inode_number);
+                    if (found) {
+                        size_t first;
+                        const char *target;
+                        memcpy(&first, found, sizeof(first)); /* Unaligned */
+                        target = metas.entries[first].path;
+                        fprintf(stderr, "Hardlink: %s to %s\n",
+                            prefixed_path_to_extract, target);
+                        unlink(prefixed_path_to_extract);
+                        if (link(target, prefixed_path_to_extract) == -1)
+                            die("link error");
+                        fprintf(stderr, "\n");
+                        continue;
+                    }
+                }
+                
+                if (S_ISDIR(st.st_mode)){
                     fprintf(stderr, "inode.xtra.dir.parent_inode: %ui\n", inode.xtra.dir.parent_inode);
                     fprintf(stderr, "mkdir: %s/\n", prefixed_path_to_extract);
                     if (access(prefixed_path_to_extract, F_OK ) == -1 ) {
@@ -85,10 +649,8 @@ int main(int argc, char *argv[]) {
                             exit(1);
                         }
                     }
-                } else if (inode.base.inode_type == SQUASHFS_REG_TYPE){
+                } else if (S_ISREG(st.st_mode)){
                     fprintf(stderr, "Extract to: %s\n", prefixed_path_to_extract);
-                    if (sqfs_stat(&fs, &inode, &st) != 0)
-                        die("sqfs_stat error");
                     printf("Permissions: ");
                     printf( (S_ISDIR(st.st_mode)) ? "d" : "-");
                     printf( (st.st_mode & S_IRUSR) ? "r" : "-");
@@ -102,28 +664,12 @@ int main(int argc, char *argv[]) {
                     printf( (st.st_mode & S_IXOTH) ? "x" : "-");
                     printf("\n");
         
-                    // Read the file in chunks
-                    off_t bytes_already_read = 0;
-                    sqfs_off_t bytes_at_a_time = 64*1024;
-                    FILE * f;
-                    f = fopen (prefixed_path_to_extract, "w+");
-                    if (f == NULL)
-                        die("fopen error");
-                    while (bytes_already_read < inode.xtra.reg.file_size)
-                    {
-                        char buf[bytes_at_a_time];
-                        if (sqfs_read_range(&fs, &inode, (sqfs_off_t) bytes_already_read, &bytes_at_a_time, buf))
-                            die("sqfs_read_range error");
-                        // fwrite(buf, 1, bytes_at_a_time, stdout);
-                        fwrite(buf, 1, bytes_at_a_time, f);                 
-                        bytes_already_read = bytes_already_read + bytes_at_a_time;
-                    }
-                    fclose(f);
-                    chmod (prefixed_path_to_extract, st.st_mode);
-                } else if (inode.base.inode_type == SQUASHFS_SYMLINK_TYPE){
-                    size_t size = strlen(trv.path)+1;
+                    extract_file_add(&self, prefixed_path_to_extract,
+                        trv.entry.inode, &inode, piece_size);
+                } else if (S_ISLNK(st.st_mode)){
+                    size_t size = inode.xtra.symlink_size + 1;
                     char buf[size];
-                    int ret = sqfs_readlink(&fs, &inode, buf, &size);
+                    int ret = sqfs_readlink(fs, &inode, buf, &size);
                     if (ret != 0)
                         die("sqfs_readlink error");
                     fprintf(stderr, "Symlink: %s to %s \n", prefixed_path_to_extract, buf);
@@ -132,7 +678,22 @@ int main(int argc, char *argv[]) {
                     if (ret != 0)
                         die("symlink error");
                 } else {
-                    fprintf(stderr, "TODO: Implement inode.base.inode_type %i\n", inode.base.inode_type);
+                    /* Devices, fifos and sockets */
+                    fprintf(stderr, "mknod: %s\n", prefixed_path_to_extract);
+                    unlink(prefixed_path_to_extract);
+                    if (mknod(prefixed_path_to_extract, st.st_mode & ~07777,
+                            st.st_rdev) == -1) {
+                        /* Devices need privileges, keep going without */
+                        perror("mknod error");
+                        fprintf(stderr, "\n");
+                        continue;
+                    }
+                }
+                extract_meta_add(prefixed_path_to_extract, trv.entry.inode);
+                if (!S_ISDIR(st.st_mode) && inode.nlink > 1) {
+                    size_t idx = metas.count - 1;
+                    if (sqfs_hash_add(&hardlinks, inode.base.inode_number, &idx))
+                        die("sqfs_hash_add error");
                 }
                 fprintf(stderr, "\n");
             }
@@ -141,6 +702,14 @@ int main(int argc, char *argv[]) {
     if (err)
         die("sqfs_traverse_next error");
     sqfs_traverse_close(&trv);
-    sqfs_fd_close(fs.fd);
+    if (disk_order)
+        extract_pending(&self);
+    workers_finish();
+    free(pending.pieces);
+    extract_metas(fs);
+    sqfs_hash_destroy(&hardlinks);
+    free(self.buf);
+    sqfs_destroy(fs);
+    sqfs_fd_close(fs->fd);
     return 0;
 }
@@ -110,17 +110,124 @@ sqfs_err sqfs_blocklist_next(sqfs_blocklist *bl) {
 	return SQFS_OK;
 }
 
+/*
+Consecutive data blocks of a file are contiguous on disk, so rather than
+issuing one pread per block we read the compressed contents of a whole run
+of blocks at once into fs->raw_cache, and decode each block from there.
+
+A run covers all the blocks needed by the current request, plus a few more
+blocks of read-ahead so that the next sequential request needs no I/O.
+*/
+#define DATA_READAHEAD_BLKS 4
+#define DATA_RUN_MAX_BLKS 32
+
+/* Fill the raw cache with the run of blocks starting at 'bl', for a request
+ * that ends at file offset 'end' */
+static sqfs_err sqfs_raw_cache_fill(sqfs *fs, sqfs_blocklist *bl,
+		sqfs_off_t end) {
+	sqfs_blocklist run = *bl;
+	uint64_t run_end = bl->block + bl->input_size;
+	size_t blocks = 1, ahead = 0;
+	
+	while (run.remain > 0 && blocks < DATA_RUN_MAX_BLKS) {
+		if (sqfs_blocklist_next(&run))
+			break; /* Let the caller find the error, if it needs this block */
+		if (run.pos >= end && ++ahead > DATA_READAHEAD_BLKS)
+			break;
+		run_end = run.block + run.input_size;
+		++blocks;
+	}
+	
+	return sqfs_raw_cache_read(fs, &fs->raw_cache, bl->block,
+		(size_t)(run_end - bl->block));
+}
+
+/* Decode the data block the blocklist points at */
+static sqfs_err sqfs_read_range_load(sqfs *fs, sqfs_blocklist *bl,
+		sqfs_off_t end, sqfs_block **block) {
+	sqfs_err err;
+	bool compressed;
+	uint32_t size;
+	void *raw;
+	
+	sqfs_data_header(bl->header, &compressed, &size);
+	if (!(raw = sqfs_raw_cache_get(&fs->raw_cache, bl->block, size))) {
+		if ((err = sqfs_raw_cache_fill(fs, bl, end)))
+			return err;
+		raw = sqfs_raw_cache_get(&fs->raw_cache, bl->block, size);
+	}
+	
+	return sqfs_data_block_decode(fs, bl->block, raw, bl->header, block);
+}
+
+/* Get the data block the blocklist points at, from the stream or the cache
+ * if possible. A block we have to decode goes to the stream if there is one,
+ * otherwise to the cache. */
+static sqfs_err sqfs_read_range_block(sqfs *fs, sqfs_stream *stream,
+		sqfs_blocklist *bl, sqfs_off_t end, sqfs_block **block) {
+	sqfs_block_cache_entry *entry;
+	sqfs_err err;
+	
+	if (stream && stream->block && stream->pos == bl->block) {
+		++fs->stats.stream_hits;
+		*block = stream->block;
+		return SQFS_OK;
+	}
+	
+	if ((entry = sqfs_cache_get(&fs->data_cache, bl->block))) {
+		*block = entry->block;
+		return SQFS_OK;
+	}
+	
+	if ((err = sqfs_read_range_load(fs, bl, end, block)))
+		return err;
+	if (stream) {
+		sqfs_stream_destroy(stream);
+		stream->pos = bl->block;
+		stream->block = *block;
+	} else {
+		entry = sqfs_cache_add(&fs->data_cache, bl->block);
+		entry->block = *block;
+	}
+	return SQFS_OK;
+}
+
+void sqfs_stream_init(sqfs_stream *stream) {
+	stream->pos = 0;
+	stream->block = NULL;
+}
+
+void sqfs_stream_destroy(sqfs_stream *stream) {
+	if (stream->block)
+		sqfs_block_dispose(stream->block);
+	sqfs_stream_init(stream);
+}
+
 sqfs_err sqfs_read_range(sqfs *fs, sqfs_inode *inode, sqfs_off_t start,
 		sqfs_off_t *size, void *buf) {
+	return sqfs_read_range_stream(fs, inode, NULL, start, size, buf);
+}
+
+sqfs_err sqfs_read_range_stream(sqfs *fs, sqfs_inode *inode,
+		sqfs_stream *stream, sqfs_off_t start, sqfs_off_t *size, void *buf) {
+	return sqfs_read_range_holes(fs, inode, stream, start, size, buf, NULL,
+		NULL);
+}
+
+sqfs_err sqfs_read_range_holes(sqfs *fs, sqfs_inode *inode,
+		sqfs_stream *stream, sqfs_off_t start, sqfs_off_t *size, void *buf,
+		sqfs_hole *holes, size_t *nholes) {
 	sqfs_err err = SQFS_OK;
 	
-	sqfs_off_t file_size;
+	sqfs_off_t file_size, end;
 	size_t block_size;
 	sqfs_blocklist bl;
 	
-	size_t read_off;
+	size_t read_off, max_holes = nholes ? *nholes : 0;
 	char *buf_orig;
 	
+	if (nholes)
+		*nholes = 0;
 	if (!S_ISREG(inode->base.mode))
 		return SQFS_ERR;
 	
@@ -138,6 +245,7 @@ sqfs_err sqfs_read_range(sqfs *fs, sqfs_inode *inode, sqfs_off_t start,
 	if (err)
 		return err;
 	
+	end = start + *size;
 	read_off = start % block_size;
 	buf_orig = buf;
 	while (*size > 0) {
@@ -164,8 +272,7 @@ sqfs_err sqfs_read_range(sqfs *fs, sqfs_inode *inode, sqfs_off_t start,
 				if (data_size > block_size)
 					data_size = block_size;
 			} else {
-				err = sqfs_data_cache(fs, &fs->data_cache, bl.block,
-					bl.header, &block);
+				err = sqfs_read_range_block(fs, stream, &bl, end, &block);
 				if (err)
 					return err;
 				data_size = block->size;
@@ -178,6 +285,9 @@ sqfs_err sqfs_read_range(sqfs *fs, sqfs_inode *inode, sqfs_off_t start,
 		if (block) {
 			memcpy(buf, (char*)block->data + data_off + read_off, take);
 			/* BLOCK CACHED, DON'T DISPOSE */
+		} else if (nholes && *nholes < max_holes) {
+			holes[*nholes].off = (char*)buf - buf_orig;
+			holes[(*nholes)++].size = take;
 		} else {
 			memset(buf, 0, take);
 		}
@@ -193,6 +303,77 @@ sqfs_err sqfs_read_range(sqfs *fs, sqfs_inode *inode, sqfs_off_t start,
 	return *size ? SQFS_OK : SQFS_ERR;
 }
 
+sqfs_err sqfs_file_seek(sqfs *fs, sqfs_inode *inode, sqfs_off_t start,
+		bool hole, sqfs_off_t *pos) {
+	sqfs_off_t file_size = inode->xtra.reg.file_size, blocks_end;
+	size_t block_size = fs->sb.block_size;
+	sqfs_blocklist bl;
+	sqfs_err err;
+	
+	if (!S_ISREG(inode->base.mode) || start < 0 || start >= file_size)
+		return SQFS_ERR;
+	
+	if ((err = sqfs_blockidx_blocklist(fs, inode, &bl, start)))
+		return err;
+	while (bl.remain > 0) {
+		if ((err = sqfs_blocklist_next(&bl)))
+			return err;
+		if (bl.pos + block_size <= start)
+			continue;
+		if ((bl.input_size == 0) == hole) {
+			*pos = (sqfs_off_t)bl.pos > start ? (sqfs_off_t)bl.pos : start;
+			return SQFS_OK;
+		}
+	}
+	
+	/* All that's left is the fragment, which is data, and the end of the
+	   file, which counts as a hole */
+	blocks_end = (sqfs_off_t)sqfs_blocklist_count(fs, inode) * block_size;
+	if (hole)
+		*pos = file_size;
+	else if (blocks_end < file_size)
+		*pos = blocks_end > start ? blocks_end : start;
+	else
+		*pos = -1;
+	return SQFS_OK;
+}
+
+uint64_t sqfs_file_blocks(sqfs_inode *inode) {
+	uint64_t size = inode->xtra.reg.file_size, sparse = inode->xtra.reg.sparse;
+	/* Like Linux's squashfs, leave out the holes mksquashfs counted */
+	return sparse < size ? (size - sparse + 511) / 512 : 0;
+}
+
+bool sqfs_file_stored_raw(sqfs *fs, sqfs_inode *inode, uint64_t *start) {
+	sqfs_blocklist bl;
+	uint64_t file_size, expect;
+	bool compressed;
+	uint32_t size;
+	
+	if (!S_ISREG(inode->base.mode) || fs->crypto
+			|| inode->xtra.reg.frag_idx != SQUASHFS_INVALID_FRAG)
+		return false;
+	file_size = inode->xtra.reg.file_size;
+	if (file_size == 0)
+		return false;
+	
+	/* Every block must be stored uncompressed and full, holes aren't */
+	sqfs_blocklist_init(fs, inode, &bl);
+	while (bl.remain > 0) {
+		if (sqfs_blocklist_next(&bl))
+			return false;
+		sqfs_data_header(bl.header, &compressed, &size);
+		expect = file_size - bl.pos;
+		if (expect > fs->sb.block_size)
+			expect = fs->sb.block_size;
+		if (compressed || size != expect)
+			return false;
+	}
+	
+	*start = fs->offset + inode->xtra.reg.start_block;
+	return true;
+}
+
 
 /*
 To read block N of a M-block file, we have to read N blocksizes from the,
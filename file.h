@@ -60,6 +60,48 @@ sqfs_err sqfs_blocklist_next(sqfs_blocklist *bl);
 sqfs_err sqfs_read_range(sqfs *fs, sqfs_inode *inode, sqfs_off_t start,
 	sqfs_off_t *size, void *buf);
 
+/* The last data block one reader decoded, which it owns. Reads that straddle
+   block boundaries then decode each block once, however small the shared
+   data cache is and however many readers share it. */
+typedef struct {
+	uint64_t pos;			/* Location of the block in the archive */
+	sqfs_block *block;		/* NULL if there's none yet */
+} sqfs_stream;
+
+void sqfs_stream_init(sqfs_stream *stream);
+void sqfs_stream_destroy(sqfs_stream *stream);
+
+/* Like sqfs_read_range, keeping newly decoded blocks in 'stream' rather than
+   in the data cache */
+sqfs_err sqfs_read_range_stream(sqfs *fs, sqfs_inode *inode,
+	sqfs_stream *stream, sqfs_off_t start, sqfs_off_t *size, void *buf);
+
+/* A hole in a range read with sqfs_read_range_holes, relative to 'buf' */
+typedef struct {
+	size_t off, size;
+} sqfs_hole;
+
+/* Like sqfs_read_range_stream, but rather than zeroing holes in 'buf', leave
+   them alone and describe them in 'holes', one per block, so the caller can
+   supply zeros some cheaper way. Once *nholes holes are described, the rest
+   are zeroed as usual. *nholes becomes the number described. */
+sqfs_err sqfs_read_range_holes(sqfs *fs, sqfs_inode *inode,
+	sqfs_stream *stream, sqfs_off_t start, sqfs_off_t *size, void *buf,
+	sqfs_hole *holes, size_t *nholes);
+
+/* Find the first data, or the first hole, at or after 'start', which must be
+   within the file. There's always a hole at the end of the file. If there's
+   no data, *pos is -1. */
+sqfs_err sqfs_file_seek(sqfs *fs, sqfs_inode *inode, sqfs_off_t start,
+	bool hole, sqfs_off_t *pos);
+
+/* The number of 512-byte blocks the file's data takes, not counting holes */
+uint64_t sqfs_file_blocks(sqfs_inode *inode);
+
+/* Is the file stored verbatim and contiguously in the image, so it can be
+   read straight from the image file? If so, *start is its offset there. */
+bool sqfs_file_stored_raw(sqfs *fs, sqfs_inode *inode, uint64_t *start);
+
 
 /*** Block index for skipping to the middle of large files ***/
 
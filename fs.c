@@ -29,6 +29,9 @@
 #include "swap.h"
 #include "xattr.h"
 #include "crypto.h"
+#include "diskcache.h"
+#include "shmcache.h"
+#include "trace.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -38,6 +41,16 @@
 #define DATA_CACHED_BLKS 1
 #define FRAG_CACHED_BLKS 3
 
+/* Metadata blocks are read in runs of this many bytes, rather than one
+ * block at a time */
+#define MD_READAHEAD (64 * 1024)
+/* If all the metadata tables are smaller than this, read them at mount */
+#define MD_PRELOAD_MAX (1024 * 1024)
+
+static sqfs_err sqfs_init_image(sqfs *fs);
+static sqfs_err sqfs_md_preload(sqfs *fs);
+static void sqfs_md_arena_destroy(sqfs_md_arena *arena);
+
 void sqfs_version_supported(int *min_major, int *min_minor, int *max_major,
 		int *max_minor) {
 	*min_major = *max_major = SQUASHFS_MAJOR;
@@ -65,7 +78,25 @@ sqfs_err sqfs_init(sqfs *fs, sqfs_fd_t fd, size_t offset, const char *key) {
 		err = crypt_init_key(fs, key);
 		if(err) return err;
 	}
+	if ((err = sqfs_init_image(fs)))
+		return err;
+	sqfs_md_preload(fs); /* Just an optimization, ok to fail */
+	return SQFS_OK;
+}
+
+sqfs_err sqfs_init_clone(sqfs *fs, sqfs *orig) {
+	memset(fs, 0, sizeof(*fs));
+	
+	fs->fd = orig->fd;
+	fs->offset = orig->offset;
+	if (orig->crypto && crypt_clone(fs, orig))
+		return SQFS_ERR;
+	return sqfs_init_image(fs);
+}
 
+static sqfs_err sqfs_init_image(sqfs *fs) {
+	sqfs_err err;
+	
 	if (sqfs_pread(fs, &fs->sb, sizeof(fs->sb), 0) != sizeof(fs->sb))
 		return SQFS_BADFORMAT;
 	sqfs_swapin_super_block(&fs->sb);
@@ -99,7 +130,6 @@ sqfs_err sqfs_init(sqfs *fs, sqfs_fd_t fd, size_t offset, const char *key) {
 		sqfs_destroy(fs);
 		return SQFS_ERR;
 	}
-	
 	return SQFS_OK;
 }
 
@@ -112,6 +142,14 @@ void sqfs_destroy(sqfs *fs) {
 	sqfs_cache_destroy(&fs->data_cache);
 	sqfs_cache_destroy(&fs->frag_cache);
 	sqfs_cache_destroy(&fs->blockidx);
+	sqfs_raw_cache_destroy(&fs->raw_cache);
+	sqfs_raw_cache_destroy(&fs->md_raw_cache);
+	sqfs_raw_cache_destroy(&fs->md_preload);
+	sqfs_md_arena_destroy(&fs->md_arena);
+	sqfs_disk_cache_destroy(fs);
+	sqfs_shm_cache_destroy(fs);
+	free(fs->crypto);
+	fs->crypto = NULL;
 }
 
 void sqfs_md_header(uint16_t hdr, bool *compressed, uint16_t *size) {
@@ -126,11 +164,27 @@ void sqfs_data_header(uint32_t hdr, bool *compressed, uint32_t *size) {
 	*size = hdr & ~SQUASHFS_COMPRESSED_BIT_BLOCK;
 }
 
+/* Decompress, keeping count */
+static sqfs_err sqfs_decompress(sqfs *fs, void *in, size_t insz,
+		void *out, size_t *outsz) {
+	sqfs_err err;
+	SQFS_TRACE1(decompress__start, insz);
+	err = fs->decompressor(in, insz, out, outsz);
+	SQFS_TRACE3(decompress__done, insz, err ? 0 : *outsz, err);
+	if (!err) {
+		++fs->stats.decompress_blocks;
+		fs->stats.decompress_in += insz;
+		fs->stats.decompress_out += *outsz;
+	}
+	return err;
+}
+
 sqfs_err sqfs_block_read(sqfs *fs, sqfs_off_t pos, bool compressed,
 		uint32_t size, size_t outsize, sqfs_block **block) {
 	sqfs_err err = SQFS_ERR;
+	SQFS_TRACE3(block__read__start, pos, size, compressed);
 	if (!(*block = malloc(sizeof(**block))))
-		return SQFS_ERR;
+		goto done;
 	if (!((*block)->data = malloc(size)))
 		goto error;
 	
@@ -142,7 +196,7 @@ sqfs_err sqfs_block_read(sqfs *fs, sqfs_off_t pos, bool compressed,
 		if (!decomp)
 			goto error;
 		
-		err = fs->decompressor((*block)->data, size, decomp, &outsize);
+		err = sqfs_decompress(fs, (*block)->data, size, decomp, &outsize);
 		if (err) {
 			free(decomp);
 			goto error;
@@ -151,9 +205,40 @@ sqfs_err sqfs_block_read(sqfs *fs, sqfs_off_t pos, bool compressed,
 		(*block)->data = decomp;
 		(*block)->size = outsize;
 	} else {
+		++fs->stats.stored_blocks;
 		(*block)->size = size;
 	}
 
+	SQFS_TRACE3(block__read__done, pos, (*block)->size, SQFS_OK);
+	return SQFS_OK;
+
+error:
+	sqfs_block_dispose(*block);
+	*block = NULL;
+done:
+	SQFS_TRACE3(block__read__done, pos, 0, err);
+	return err;
+}
+
+sqfs_err sqfs_block_decode(sqfs *fs, const void *in, bool compressed,
+		uint32_t size, size_t outsize, sqfs_block **block) {
+	sqfs_err err = SQFS_ERR;
+	if (!(*block = malloc(sizeof(**block))))
+		return SQFS_ERR;
+	if (!((*block)->data = malloc(compressed ? outsize : size)))
+		goto error;
+	
+	if (compressed) {
+		err = sqfs_decompress(fs, (void*)in, size, (*block)->data, &outsize);
+		if (err)
+			goto error;
+		(*block)->size = outsize;
+	} else {
+		++fs->stats.stored_blocks;
+		memcpy((*block)->data, in, size);
+		(*block)->size = size;
+	}
+	
 	return SQFS_OK;
 
 error:
@@ -162,24 +247,73 @@ error:
 	return err;
 }
 
+/* The metadata tables run from the inode table up to the first of the
+ * table indices that follow it */
+static sqfs_off_t sqfs_md_end(sqfs *fs) {
+	struct squashfs_super_block *sb = &fs->sb;
+	uint64_t end = sb->bytes_used;
+	if (sb->fragments && sb->fragment_table_start < end)
+		end = sb->fragment_table_start;
+	if (sqfs_export_ok(fs) && sb->lookup_table_start < end)
+		end = sb->lookup_table_start;
+	if (sb->xattr_id_table_start < end)
+		end = sb->xattr_id_table_start;
+	if (sb->id_table_start < end)
+		end = sb->id_table_start;
+	return end;
+}
+
+/* Read all the metadata tables into a buffer of their own, so read-ahead
+ * elsewhere never evicts them */
+static sqfs_err sqfs_md_preload(sqfs *fs) {
+	sqfs_off_t start = fs->sb.inode_table_start, end = sqfs_md_end(fs);
+	if (end <= start || end - start > MD_PRELOAD_MAX)
+		return SQFS_OK;
+	return sqfs_raw_cache_read(fs, &fs->md_preload, start,
+		(size_t)(end - start));
+}
+
+/* Get raw metadata bytes, reading ahead a run of blocks if necessary */
+static void *sqfs_md_raw(sqfs *fs, sqfs_off_t pos, size_t size) {
+	void *raw;
+	size_t want = MD_READAHEAD;
+	
+	if ((raw = sqfs_raw_cache_get(&fs->md_preload, pos, size)))
+		return raw;
+	if ((raw = sqfs_raw_cache_get(&fs->md_raw_cache, pos, size)))
+		return raw;
+	
+	if (pos + want > fs->sb.bytes_used)
+		want = (size_t)(fs->sb.bytes_used - pos);
+	if (want < size)
+		want = size;
+	if (sqfs_raw_cache_read(fs, &fs->md_raw_cache, pos, want))
+		return NULL;
+	return sqfs_raw_cache_get(&fs->md_raw_cache, pos, size);
+}
+
 sqfs_err sqfs_md_block_read(sqfs *fs, sqfs_off_t pos, size_t *data_size,
 		sqfs_block **block) {
 	sqfs_err err = SQFS_OK;
 	uint16_t hdr;
 	bool compressed;
 	uint16_t size;
+	void *raw;
 	
 	*data_size = 0;
 	
-	if (sqfs_pread(fs, &hdr, sizeof(hdr), pos) != sizeof(hdr))
+	if (!(raw = sqfs_md_raw(fs, pos, sizeof(hdr))))
 		return SQFS_ERR;
+	memcpy(&hdr, raw, sizeof(hdr));
 	pos += sizeof(hdr);
 	*data_size += sizeof(hdr);
 	sqfs_swapin16(&hdr);
 	
 	sqfs_md_header(hdr, &compressed, &size);
 	
-	err = sqfs_block_read(fs, pos, compressed, size,
+	if (!(raw = sqfs_md_raw(fs, pos, size)))
+		return SQFS_ERR;
+	err = sqfs_block_decode(fs, raw, compressed, size,
 		SQUASHFS_METADATA_SIZE, block);
 	*data_size += size;
 	return err;
@@ -187,15 +321,176 @@ sqfs_err sqfs_md_block_read(sqfs *fs, sqfs_off_t pos, size_t *data_size,
 
 sqfs_err sqfs_data_block_read(sqfs *fs, sqfs_off_t pos, uint32_t hdr,
 		sqfs_block **block) {
+	sqfs_err err;
 	bool compressed;
 	uint32_t size;
+	void *raw;
+	
 	sqfs_data_header(hdr, &compressed, &size);
-	return sqfs_block_read(fs, pos, compressed, size,
-		fs->sb.block_size, block);
+	if (!compressed || (!fs->shm_cache && !fs->disk_cache))
+		return sqfs_block_read(fs, pos, compressed, size,
+			fs->sb.block_size, block);
+	
+	/* The shared caches need the on-disk bytes anyway */
+	if (!(raw = malloc(size)))
+		return SQFS_ERR;
+	if (sqfs_pread(fs, raw, size, pos) != (ssize_t)size) {
+		free(raw);
+		return SQFS_ERR;
+	}
+	err = sqfs_data_block_decode(fs, pos, raw, hdr, block);
+	free(raw);
+	return err;
+}
+
+sqfs_err sqfs_data_block_decode(sqfs *fs, sqfs_off_t pos, const void *raw,
+		uint32_t hdr, sqfs_block **block) {
+	sqfs_err err;
+	bool compressed;
+	uint32_t size;
+	uint64_t sum;
+	
+	sqfs_data_header(hdr, &compressed, &size);
+	if (!compressed || (!fs->shm_cache && !fs->disk_cache))
+		return sqfs_block_decode(fs, raw, compressed, size,
+			fs->sb.block_size, block);
+	
+	sum = sqfs_content_hash(SQFS_CONTENT_HASH_INIT, raw, size);
+	if (sqfs_shared_cache_get(fs, pos, sum, block) == SQFS_OK)
+		return SQFS_OK;
+	if ((err = sqfs_block_decode(fs, raw, compressed, size,
+			fs->sb.block_size, block)))
+		return err;
+	sqfs_shared_cache_put(fs, pos, sum, *block);
+	return SQFS_OK;
+}
+
+static void sqfs_md_arena_destroy(sqfs_md_arena *arena) {
+	free(arena->entries);
+	free(arena->data);
+	memset(arena, 0, sizeof(*arena));
+}
+
+sqfs_err sqfs_md_arena_load(sqfs *fs) {
+	sqfs_md_arena *arena = &fs->md_arena;
+	sqfs_off_t start = fs->sb.inode_table_start, end = sqfs_md_end(fs), pos;
+	size_t cap = 0, used = 0, i;
+	char *raw;
+	
+	sqfs_md_arena_destroy(arena);
+	if (end <= start)
+		return SQFS_OK;
+	
+	if (!(raw = sqfs_raw_cache_get(&fs->md_preload, start,
+			(size_t)(end - start))) &&
+			!(raw = sqfs_raw_cache_get(&fs->md_raw_cache, start,
+			(size_t)(end - start)))) {
+		if (sqfs_raw_cache_read(fs, &fs->md_raw_cache, start,
+				(size_t)(end - start)))
+			return SQFS_ERR;
+		raw = fs->md_raw_cache.data;
+	}
+	
+	/* Decompress each block to the end of the arena. Store offsets rather than
+	 * pointers until we're done growing it. */
+	for (pos = start; pos + sizeof(uint16_t) <= end; ) {
+		sqfs_md_arena_entry *entry;
+		uint16_t hdr;
+		bool compressed;
+		uint16_t size;
+		size_t outsize = SQUASHFS_METADATA_SIZE;
+		char *in = raw + (pos - start) + sizeof(hdr);
+		
+		memcpy(&hdr, in - sizeof(hdr), sizeof(hdr));
+		sqfs_swapin16(&hdr);
+		sqfs_md_header(hdr, &compressed, &size);
+		if (pos + sizeof(hdr) + size > end)
+			goto error;
+		
+		if (arena->count == cap) {
+			size_t ncap = cap ? cap * 2 : 64;
+			sqfs_md_arena_entry *entries;
+			char *data;
+			if (!(entries = realloc(arena->entries, ncap * sizeof(*entries))))
+				goto error;
+			arena->entries = entries;
+			if (!(data = realloc(arena->data, ncap * SQUASHFS_METADATA_SIZE)))
+				goto error;
+			arena->data = data;
+			cap = ncap;
+		}
+		
+		if (compressed) {
+			if (sqfs_decompress(fs, in, size, arena->data + used, &outsize))
+				goto error;
+		} else {
+			if (size > SQUASHFS_METADATA_SIZE)
+				goto error;
+			++fs->stats.stored_blocks;
+			memcpy(arena->data + used, in, size);
+			outsize = size;
+		}
+		
+		entry = &arena->entries[arena->count++];
+		entry->pos = pos;
+		entry->data_size = sizeof(hdr) + size;
+		entry->block.size = outsize;
+		entry->block.data = NULL;
+		used += outsize;
+		pos += entry->data_size;
+	}
+	
+	/* Everything's in the arena now, no need for the raw data */
+	sqfs_raw_cache_destroy(&fs->md_raw_cache);
+	sqfs_raw_cache_destroy(&fs->md_preload);
+	if (used) {
+		char *data = realloc(arena->data, used);
+		if (data)
+			arena->data = data;
+	}
+	
+	used = 0;
+	for (i = 0; i < arena->count; ++i) {
+		arena->entries[i].block.data = arena->data + used;
+		used += arena->entries[i].block.size;
+	}
+	return SQFS_OK;
+
+error:
+	sqfs_md_arena_destroy(arena);
+	return SQFS_ERR;
+}
+
+/* Binary search the arena for the block at pos */
+static sqfs_md_arena_entry *sqfs_md_arena_find(sqfs_md_arena *arena,
+		sqfs_off_t pos) {
+	size_t lo = 0, hi = arena->count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		sqfs_md_arena_entry *entry = &arena->entries[mid];
+		if (entry->pos == pos)
+			return entry;
+		if (entry->pos < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
 }
 
 sqfs_err sqfs_md_cache(sqfs *fs, sqfs_off_t *pos, sqfs_block **block) {
-	sqfs_block_cache_entry *entry = sqfs_cache_get(&fs->md_cache, *pos);
+	sqfs_block_cache_entry *entry;
+	
+	if (fs->md_arena.count) {
+		sqfs_md_arena_entry *aentry = sqfs_md_arena_find(&fs->md_arena, *pos);
+		if (aentry) {
+			*block = &aentry->block;
+			*pos += aentry->data_size;
+			return SQFS_OK;
+		}
+	}
+	
+	entry = sqfs_cache_get(&fs->md_cache, *pos);
 	if (!entry) {
 		sqfs_err err = SQFS_OK;
 		entry = sqfs_cache_add(&fs->md_cache, *pos);
@@ -212,14 +507,31 @@ sqfs_err sqfs_md_cache(sqfs *fs, sqfs_off_t *pos, sqfs_block **block) {
 	return SQFS_OK;
 }
 
+const char *sqfs_md_ref(sqfs *fs, sqfs_md_cursor *cur, size_t size) {
+	sqfs_md_arena *arena = &fs->md_arena;
+	sqfs_md_arena_entry *entry, *last;
+	const char *start;
+	
+	if (!arena->count || !(entry = sqfs_md_arena_find(arena, cur->block))
+			|| cur->offset > entry->block.size)
+		return NULL;
+	
+	/* Blocks are stored back-to-back, so a run of metadata that spans blocks
+	 * is contiguous too */
+	last = &arena->entries[arena->count - 1];
+	start = (char*)entry->block.data + cur->offset;
+	if (start + size > (char*)last->block.data + last->block.size)
+		return NULL;
+	return start;
+}
+
 sqfs_err sqfs_data_cache(sqfs *fs, sqfs_cache *cache, sqfs_off_t pos,
 		uint32_t hdr, sqfs_block **block) {
 	sqfs_block_cache_entry *entry = sqfs_cache_get(cache, pos);
 	if (!entry) {
 		sqfs_err err = SQFS_OK;
 		entry = sqfs_cache_add(cache, pos);
-		err = sqfs_data_block_read(fs, pos, hdr,
-			&entry->block);
+		err = sqfs_data_block_read(fs, pos, hdr, &entry->block);
 		if (err) {
 			sqfs_cache_invalidate(cache, pos);
 			return err;
@@ -229,6 +541,67 @@ sqfs_err sqfs_data_cache(sqfs *fs, sqfs_cache *cache, sqfs_off_t pos,
 	return SQFS_OK;
 }
 
+sqfs_err sqfs_shared_cache_get(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+		sqfs_block **block) {
+	if (!fs->shm_cache && !fs->disk_cache)
+		return SQFS_ERR;
+	if (sqfs_shm_cache_get(fs, pos, sum, block) == SQFS_OK) {
+		++fs->stats.shared_hits;
+		return SQFS_OK;
+	}
+	if (sqfs_disk_cache_get(fs, pos, sum, block) == SQFS_OK) {
+		++fs->stats.shared_hits;
+		sqfs_shm_cache_put(fs, pos, sum, *block);
+		return SQFS_OK;
+	}
+	++fs->stats.shared_misses;
+	return SQFS_ERR;
+}
+
+void sqfs_shared_cache_put(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+		sqfs_block *block) {
+	sqfs_shm_cache_put(fs, pos, sum, block);
+	sqfs_disk_cache_put(fs, pos, sum, block);
+}
+
+uint64_t sqfs_content_hash(uint64_t h, const void *buf, size_t size) {
+	const unsigned char *p = buf, *end = p + size;
+	for (; p < end; ++p)
+		h = (h ^ *p) * 0x100000001b3ULL; /* FNV-1a */
+	return h;
+}
+
+/* How much of the image to hash at once, to identify it */
+#define IMAGE_ID_CHUNK (64 * 1024)
+
+sqfs_err sqfs_image_id(sqfs *fs, uint64_t *id) {
+	sqfs_off_t pos = fs->sb.inode_table_start, end = fs->sb.bytes_used;
+	uint64_t h;
+	char *buf;
+	
+	if (end <= pos || !(buf = malloc(IMAGE_ID_CHUNK)))
+		return SQFS_ERR;
+	
+	/* The superblock includes the image size, and the metadata tables after
+	 * the data include every block's location and size */
+	h = sqfs_content_hash(SQFS_CONTENT_HASH_INIT, &fs->sb, sizeof(fs->sb));
+	while (pos < end) {
+		size_t want = IMAGE_ID_CHUNK;
+		if ((sqfs_off_t)want > end - pos)
+			want = (size_t)(end - pos);
+		if (sqfs_pread(fs, buf, want, pos) != (ssize_t)want) {
+			free(buf);
+			return SQFS_ERR;
+		}
+		h = sqfs_content_hash(h, buf, want);
+		pos += want;
+	}
+	free(buf);
+	
+	*id = h;
+	return SQFS_OK;
+}
+
 void sqfs_block_dispose(sqfs_block *block) {
 	free(block->data);
 	free(block);
@@ -241,12 +614,15 @@ void sqfs_md_cursor_inode(sqfs_md_cursor *cur, sqfs_inode_id id, sqfs_off_t base
 
 sqfs_err sqfs_md_read(sqfs *fs, sqfs_md_cursor *cur, void *buf, size_t size) {
 	sqfs_off_t pos = cur->block;
+	SQFS_TRACE3(md__read__start, cur->block, cur->offset, size);
 	while (size > 0) {
 		sqfs_block *block;
 		size_t take;
 		sqfs_err err = sqfs_md_cache(fs, &pos, &block);
-		if (err)
+		if (err) {
+			SQFS_TRACE3(md__read__done, cur->block, cur->offset, err);
 			return err;
+		}
 		
 		take = block->size - cur->offset;
 		if (take > size)
@@ -264,6 +640,7 @@ sqfs_err sqfs_md_read(sqfs *fs, sqfs_md_cursor *cur, void *buf, size_t size) {
 			cur->offset = 0;
 		}
 	}
+	SQFS_TRACE3(md__read__done, cur->block, cur->offset, SQFS_OK);
 	return SQFS_OK;
 }
 
@@ -366,6 +743,7 @@ sqfs_err sqfs_inode_get(sqfs *fs, sqfs_inode *inode, sqfs_inode_id id) {
 			inode->nlink = 1;
 			inode->xtra.reg.start_block = x.start_block;
 			inode->xtra.reg.file_size = x.file_size;
+			inode->xtra.reg.sparse = 0;
 			inode->xtra.reg.frag_idx = x.fragment;
 			inode->xtra.reg.frag_off = x.offset;
 			break;
@@ -375,6 +753,7 @@ sqfs_err sqfs_inode_get(sqfs *fs, sqfs_inode *inode, sqfs_inode_id id) {
 			inode->nlink = x.nlink;
 			inode->xtra.reg.start_block = x.start_block;
 			inode->xtra.reg.file_size = x.file_size;
+			inode->xtra.reg.sparse = x.sparse;
 			inode->xtra.reg.frag_idx = x.fragment;
 			inode->xtra.reg.frag_off = x.offset;
 			inode->xattr = x.xattr;
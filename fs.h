@@ -31,8 +31,22 @@
 
 #include "cache.h"
 #include "decompress.h"
+#include "stats.h"
 #include "table.h"
 
+/* Decompressed copy of all the metadata blocks, see sqfs_md_arena_load */
+typedef struct {
+	sqfs_off_t pos;			/* On-disk location of the block */
+	size_t data_size;		/* On-disk size, including header */
+	sqfs_block block;
+} sqfs_md_arena_entry;
+
+typedef struct {
+	size_t count;
+	sqfs_md_arena_entry *entries;
+	char *data;
+} sqfs_md_arena;
+
 struct sqfs {
 	sqfs_fd_t fd;
 	size_t offset;
@@ -44,8 +58,15 @@ struct sqfs {
 	sqfs_cache data_cache;
 	sqfs_cache frag_cache;
 	sqfs_cache blockidx;
+	sqfs_raw_cache raw_cache;
+	sqfs_raw_cache md_raw_cache;
+	sqfs_raw_cache md_preload;	/* All the metadata, if read at mount */
+	sqfs_md_arena md_arena;
 	sqfs_decompressor decompressor;
 	void *crypto;
+	void *disk_cache;
+	void *shm_cache;
+	sqfs_stats stats;
 	
 	struct squashfs_xattr_id_table xattr_info;
 	sqfs_table xattr_table;
@@ -68,6 +89,7 @@ struct sqfs_inode {
 		struct {
 			uint64_t start_block;
 			uint64_t file_size;
+			uint64_t sparse;	/* Bytes in holes, if known */
 			uint32_t frag_idx;
 			uint32_t frag_off;
 		} reg;
@@ -89,6 +111,10 @@ size_t sqfs_divceil(uint64_t total, size_t group);
 
 
 sqfs_err sqfs_init(sqfs *fs, sqfs_fd_t fd, size_t offset, const char *key);
+/* Open another handle on the same image as 'orig', sharing its file
+   descriptor, so another thread can read the image with its own caches.
+   Unlike sqfs_init, it doesn't preload small metadata tables. */
+sqfs_err sqfs_init_clone(sqfs *fs, sqfs *orig);
 void sqfs_destroy(sqfs *fs);
 
 /* Ok to call these even on incompletely constructed filesystems */
@@ -101,18 +127,47 @@ void sqfs_data_header(uint32_t hdr, bool *compressed, uint32_t *size);
 
 sqfs_err sqfs_block_read(sqfs *fs, sqfs_off_t pos, bool compressed, uint32_t size,
 	size_t outsize, sqfs_block **block);
+/* Like sqfs_block_read, but the on-disk contents are already in memory */
+sqfs_err sqfs_block_decode(sqfs *fs, const void *in, bool compressed,
+	uint32_t size, size_t outsize, sqfs_block **block);
 void sqfs_block_dispose(sqfs_block *block);
 
 sqfs_err sqfs_md_block_read(sqfs *fs, sqfs_off_t pos, size_t *data_size,
 	sqfs_block **block);
 sqfs_err sqfs_data_block_read(sqfs *fs, sqfs_off_t pos, uint32_t hdr,
 	sqfs_block **block);
+/* Like sqfs_data_block_read, but the on-disk contents are already in memory */
+sqfs_err sqfs_data_block_decode(sqfs *fs, sqfs_off_t pos, const void *raw,
+	uint32_t hdr, sqfs_block **block);
 
 /* Don't dispose after getting block, it's in the cache */
 sqfs_err sqfs_md_cache(sqfs *fs, sqfs_off_t *pos, sqfs_block **block);
 sqfs_err sqfs_data_cache(sqfs *fs, sqfs_cache *cache, sqfs_off_t pos,
 	uint32_t hdr, sqfs_block **block);
 
+/* Caches of decompressed data blocks that are shared with other mounts of
+ * the same image, see shmcache.h and diskcache.h. Blocks are keyed on their
+ * position and 'sum', the sqfs_content_hash of their on-disk bytes. The block
+ * from a successful get must be disposed by the caller. */
+sqfs_err sqfs_shared_cache_get(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+	sqfs_block **block);
+void sqfs_shared_cache_put(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+	sqfs_block *block);
+
+/* Hash some bytes, continuing from 'h'. Start with SQFS_CONTENT_HASH_INIT. */
+#define SQFS_CONTENT_HASH_INIT 0xcbf29ce484222325ULL
+uint64_t sqfs_content_hash(uint64_t h, const void *buf, size_t size);
+
+/* A hash identifying the contents of this image, for naming shared caches */
+sqfs_err sqfs_image_id(sqfs *fs, uint64_t *id);
+
+/* Decompress all the inode, directory and other metadata tables into memory
+ * at once, so later metadata reads need no I/O or decompression */
+sqfs_err sqfs_md_arena_load(sqfs *fs);
+/* Point at 'size' bytes of metadata in the arena, without copying. Returns
+ * NULL if the arena isn't loaded. */
+const char *sqfs_md_ref(sqfs *fs, sqfs_md_cursor *cur, size_t size);
+
 void sqfs_md_cursor_inode(sqfs_md_cursor *cur, sqfs_inode_id id, sqfs_off_t base);
 
 sqfs_err sqfs_md_read(sqfs *fs, sqfs_md_cursor *cur, void *buf, size_t size);
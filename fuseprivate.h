@@ -42,6 +42,9 @@ int sqfs_listxattr(sqfs *fs, sqfs_inode *inode, char *buf, size_t *size);
 /* Print a usage string */
 void sqfs_usage(char *progname, bool fuse_usage);
 
+/* Default bound on the disk cache, in MiB */
+#define SQFS_DISK_CACHE_SIZE 256
+
 /* Parse command-line arguments */
 typedef struct {
 	char *progname;
@@ -49,6 +52,15 @@ typedef struct {
 	int image_count;
 	size_t offset;
 	unsigned int idle_timeout_secs;
+	int preload_metadata;
+	char *disk_cache;
+	unsigned int disk_cache_size;
+	unsigned int shm_cache_size;
+	char *stats_file;
+	char *trace_file;
+	int no_cache_dir;
+	int no_cache_symlinks;
+	int no_parallel_dirops;
 } sqfs_opts;
 int sqfs_opt_proc(void *data, const char *arg, int key,
 	struct fuse_args *outargs);
@@ -27,105 +27,170 @@
 #include <stdlib.h>
 #include <string.h>
 
-static sqfs_err sqfs_hash_add_internal(sqfs_hash *h, int doubling,
-		sqfs_hash_key k, sqfs_hash_value v) {
-	size_t hash = (k & (h->capacity - 1));	
-	sqfs_hash_bucket *b = malloc(sizeof(sqfs_hash_bucket) + h->value_size);
-	if (!b)
+#define SQFS_HASH_MIN_CAPACITY 8
+
+/* Grow when the table is more than 7/8 full */
+#define SQFS_HASH_FULL(h, n) ((n) * 8 > (h)->capacity * 7)
+
+/* Each slot is a header followed by the value. An empty slot has dist zero,
+ * otherwise dist is one more than how far the entry is from its home slot. */
+typedef struct {
+	sqfs_hash_key key;
+	uint32_t dist;
+} sqfs_hash_slot;
+
+#define SLOT(h, i) ((sqfs_hash_slot*)((h)->slots + (i) * (h)->slot_size))
+#define SLOT_VALUE(s) ((char*)((s) + 1))
+
+/* The slot after the last one holds the entry being placed */
+#define SCRATCH(h) SLOT(h, (h)->capacity)
+
+/* Fibonacci hashing: the top bits of the key times 2^64 / phi. Clustered keys
+ * get spread out, and sequential ones land evenly spaced, so they rarely
+ * collide. */
+static size_t sqfs_hash_home(sqfs_hash *h, sqfs_hash_key k) {
+	return (size_t)(((uint64_t)k * 0x9e3779b97f4a7c15ULL) >> h->shift);
+}
+
+static void sqfs_hash_swap(char *a, char *b, size_t size) {
+	size_t i;
+	for (i = 0; i < size; ++i) {
+		char t = a[i];
+		a[i] = b[i];
+		b[i] = t;
+	}
+}
+
+static sqfs_err sqfs_hash_alloc(sqfs_hash *h, size_t capacity) {
+	if (!(h->slots = calloc(capacity + 1, h->slot_size)))
 		return SQFS_ERR;
-	b->key = k;
-	memcpy(&b->value, v, h->value_size);
-	b->next = h->buckets[hash];
-	h->buckets[hash] = b;
-	++h->size;
-	
+	h->capacity = capacity;
+	h->size = 0;
+	for (h->shift = 64; capacity > 1; capacity >>= 1)
+		--h->shift;
 	return SQFS_OK;
 }
 
+/* Place the entry in the scratch slot, replacing any with the same key.
+ * Richer entries, closer to home, give up their slot to poorer ones. */
+static void sqfs_hash_place(sqfs_hash *h) {
+	sqfs_hash_slot *carry = SCRATCH(h);
+	size_t mask = h->capacity - 1;
+	size_t i = sqfs_hash_home(h, carry->key);
+	
+	for (carry->dist = 1; ; ++carry->dist) {
+		sqfs_hash_slot *cur = SLOT(h, i);
+		if (cur->dist == 0) {
+			memcpy(cur, carry, h->slot_size);
+			++h->size;
+			return;
+		}
+		if (cur->dist == carry->dist && cur->key == carry->key) {
+			/* Only the new entry can match, nothing has been displaced */
+			memcpy(SLOT_VALUE(cur), SLOT_VALUE(carry), h->value_size);
+			return;
+		}
+		if (cur->dist < carry->dist)
+			sqfs_hash_swap((char*)cur, (char*)carry, h->slot_size);
+		i = (i + 1) & mask;
+	}
+}
+
 static sqfs_err sqfs_hash_double(sqfs_hash *h) {
-	sqfs_hash_bucket **ob = h->buckets;
+	char *os = h->slots;
 	size_t oc = h->capacity;
 	size_t i;
 	sqfs_err err;
 	
-	if ((err = sqfs_hash_init(h, h->value_size, oc * 2)))
+	if ((err = sqfs_hash_alloc(h, oc * 2))) {
+		h->slots = os;
 		return err;
-	
+	}
 	for (i = 0; i < oc; ++i) {
-		sqfs_hash_bucket *b = ob[i];
-		while (b) {
-			sqfs_hash_bucket *n;
-			if (!err)
-				err = sqfs_hash_add_internal(h, 1, b->key, &b->value);
-			n = b->next;
-			free(b);
-			b = n;
+		sqfs_hash_slot *s = (sqfs_hash_slot*)(os + i * h->slot_size);
+		if (s->dist) {
+			memcpy(SCRATCH(h), s, h->slot_size);
+			sqfs_hash_place(h);
 		}
 	}
+	free(os);
+	return SQFS_OK;
+}
+
+static sqfs_hash_slot *sqfs_hash_find(sqfs_hash *h, sqfs_hash_key k,
+		size_t *idx) {
+	size_t mask = h->capacity - 1;
+	size_t i = sqfs_hash_home(h, k);
+	uint32_t dist;
 	
-	free(ob);
-	return err;
+	/* Once we pass an entry closer to home than we'd be, k isn't here */
+	for (dist = 1; ; ++dist) {
+		sqfs_hash_slot *s = SLOT(h, i);
+		if (s->dist < dist)
+			return NULL;
+		if (s->key == k) {
+			if (idx)
+				*idx = i;
+			return s;
+		}
+		i = (i + 1) & mask;
+	}
 }
 
 sqfs_err sqfs_hash_init(sqfs_hash *h, size_t vsize, size_t initial) {
 	memset(h, 0, sizeof(*h));
 	if ((initial & (initial - 1))) /* not power of two? */
 		return SQFS_ERR;
+	if (initial < SQFS_HASH_MIN_CAPACITY)
+		initial = SQFS_HASH_MIN_CAPACITY;
 	
-	h->buckets = calloc(initial, sizeof(sqfs_hash_bucket*));
-	if (!h->buckets)
-		return SQFS_ERR;
-	h->capacity = initial;
-	h->size = 0;
+	/* Keep headers aligned */
 	h->value_size = vsize;
-	return SQFS_OK;
+	h->slot_size = sizeof(sqfs_hash_slot) + vsize;
+	h->slot_size += sizeof(sqfs_hash_key) - 1;
+	h->slot_size -= h->slot_size % sizeof(sqfs_hash_key);
+	return sqfs_hash_alloc(h, initial);
 }
  
 void sqfs_hash_destroy(sqfs_hash *h) {
-	size_t i;
-	for (i = 0; i < h->capacity; ++i) {
-		sqfs_hash_bucket *b = h->buckets[i];
-		while (b) {
-			sqfs_hash_bucket *n = b->next;
-			free(b);
-			b = n;
-		}
-	}
-	free(h->buckets);
+	free(h->slots);
+	h->slots = NULL;
 }
 
 sqfs_hash_value sqfs_hash_get(sqfs_hash *h, sqfs_hash_key k) {
-	size_t hash = (k & (h->capacity - 1));
-	sqfs_hash_bucket *b = h->buckets[hash];
-	while (b) {
-		if (b->key == k)
-			return &b->value;
-		b = b->next;
-	}
-	return NULL;
+	sqfs_hash_slot *s = sqfs_hash_find(h, k, NULL);
+	return s ? SLOT_VALUE(s) : NULL;
 }
 
 sqfs_err sqfs_hash_add(sqfs_hash *h, sqfs_hash_key k, sqfs_hash_value v) {
-	if (h->size >= h->capacity) {
+	sqfs_hash_slot *s;
+	if (SQFS_HASH_FULL(h, h->size + 1)) {
 		sqfs_err err = sqfs_hash_double(h);
 		if (err)
 			return err;
 	}
-	return sqfs_hash_add_internal(h, 0, k, v);
+	
+	s = SCRATCH(h);
+	s->key = k;
+	memcpy(SLOT_VALUE(s), v, h->value_size);
+	sqfs_hash_place(h);
+	return SQFS_OK;
 }
 
 sqfs_err sqfs_hash_remove(sqfs_hash *h, sqfs_hash_key k) {
-	size_t hash = (k & (h->capacity - 1));
-	sqfs_hash_bucket **bp = &h->buckets[hash];
-	while (*bp) {
-		if ((*bp)->key == k) {
-			sqfs_hash_bucket *b = *bp;
-			*bp = b->next;
-			free(b);
-			--h->size;
-			return SQFS_OK;
-		}
-		bp = &(*bp)->next;
+	size_t mask = h->capacity - 1;
+	size_t i, j;
+	
+	if (!sqfs_hash_find(h, k, &i))
+		return SQFS_OK;
+	
+	/* Pull back the following entries that aren't already home */
+	for (j = (i + 1) & mask; SLOT(h, j)->dist > 1; j = (j + 1) & mask) {
+		memcpy(SLOT(h, i), SLOT(h, j), h->slot_size);
+		--SLOT(h, i)->dist;
+		i = j;
 	}
+	SLOT(h, i)->dist = 0;
+	--h->size;
 	return SQFS_OK;
 }
@@ -29,34 +29,35 @@
 
 /* Simple hashtable
  *	- Keys are integers
- *	- Values are opaque data
+ *	- Values are opaque data of a fixed size, stored inline
  *
  * Implementation
- *	- Hash function is modulus
- *	- Chaining for duplicates
+ *	- Open addressing with Robin Hood linear probing, so lookups stay short
+ *	  even when the table is nearly full
+ *	- Keys are mixed with Fibonacci hashing, which keeps sequential keys
+ *	  such as inode numbers from colliding
  *	- Sizes are powers of two
+ *	- Deletion shifts later entries back, so there are no tombstones
  */
 typedef uint32_t sqfs_hash_key;
 typedef void *sqfs_hash_value;
 
-typedef struct sqfs_hash_bucket {
-	struct sqfs_hash_bucket *next;
-	sqfs_hash_key key;
-	char value[1]; /* extended to size */
-} sqfs_hash_bucket;
-
 typedef struct {
 	size_t value_size;
+	size_t slot_size;
 	size_t capacity;
 	size_t size;
-	sqfs_hash_bucket **buckets;
+	int shift;			/* 64 - log2(capacity) */
+	char *slots;
 } sqfs_hash;
 
 sqfs_err sqfs_hash_init(sqfs_hash *h, size_t vsize, size_t initial);
 void sqfs_hash_destroy(sqfs_hash *h);
 
+/* The returned pointer is only valid until the next add or remove */
 sqfs_hash_value sqfs_hash_get(sqfs_hash *h, sqfs_hash_key k);
 
+/* Adding a key that's already present replaces its value */
 sqfs_err sqfs_hash_add(sqfs_hash *h, sqfs_hash_key k, sqfs_hash_value v);
 sqfs_err sqfs_hash_remove(sqfs_hash *h, sqfs_hash_key k);
 
@@ -2,114 +2,133 @@
 #include <string.h>
 #include "hashset.h"
 
+/* Keys are copied into chunks of at least this size, doubling up to the
+ * maximum as the set grows */
+#define HASHSET_CHUNK_MIN 4096
+#define HASHSET_CHUNK_MAX (256 * 1024)
+
+#define HASHSET_INITIAL_SLOTS 64
+
+struct hashset_chunk {
+  hashset_chunk *next;
+  size_t size, used;
+  /* char data[]; */
+};
+
 void hashset_init(hashset *m) {
-	m->buckets = NULL;
-	m->nbuckets = m->nnodes = 0;
+  m->slots = NULL;
+  m->nslots = m->nkeys = 0;
+  m->chunks = NULL;
 }
 
-static unsigned str_hash(const char *str) {
-  unsigned hash = 5381;
-  while (*str) {
-    hash = ((hash << 5) + hash) ^ *str++;
+/* FNV-1a, with a final mix so the low bits depend on every byte */
+static unsigned str_hash(const char *str, size_t *len) {
+  const unsigned char *p = (const unsigned char *)str;
+  unsigned hash = 2166136261u;
+  while (*p) {
+    hash ^= *p++;
+    hash *= 16777619u;
   }
+  *len = p - (const unsigned char *)str;
+  hash ^= hash >> 15;
+  hash *= 0x2c1b3c6du;
+  hash ^= hash >> 12;
   return hash;
 }
 
-static hashset_node *hashset_newnode(const char *key) {
-  hashset_node *node;
-  int ksize = strlen(key) + 1;
-  node = malloc(sizeof(*node) + ksize);
-  if (!node) return NULL;
-  memcpy(node + 1, key, ksize);
-  node->hash = str_hash(key);
-  return node;
+static const char *hashset_copykey(hashset *m, const char *key, size_t len) {
+  hashset_chunk *c = m->chunks;
+  char *dst;
+  if (!c || c->size - c->used < len + 1) {
+    size_t size = c ? c->size * 2 : HASHSET_CHUNK_MIN;
+    if (size > HASHSET_CHUNK_MAX)
+      size = HASHSET_CHUNK_MAX;
+    if (size < len + 1)
+      size = len + 1;
+    c = malloc(sizeof(*c) + size);
+    if (!c) return NULL;
+    c->size = size;
+    c->used = 0;
+    c->next = m->chunks;
+    m->chunks = c;
+  }
+  dst = (char *)(c + 1) + c->used;
+  memcpy(dst, key, len + 1);
+  c->used += len + 1;
+  return dst;
 }
 
-static int hashset_bucketidx(hashset *m, unsigned hash) {
-  /* If the implementation is changed to allow a non-power-of-2 bucket count,
-   * the line below should be changed to use mod instead of AND */
-  return hash & (m->nbuckets - 1);
+/* Find the key's slot, or the empty slot where it belongs */
+static hashset_slot *hashset_find(hashset *m, const char *key,
+    unsigned hash) {
+  unsigned mask = m->nslots - 1, i = hash & mask;
+  hashset_slot *s;
+  while ((s = &m->slots[i])->key) {
+    if (s->hash == hash && !strcmp(s->key, key))
+      break;
+    i = (i + 1) & mask;
+  }
+  return s;
 }
 
-static int hashset_resize(hashset *m, int nbuckets) {
-  hashset_node *node, *next;
-  hashset_node **old_buckets = m->buckets;
-  int i = m->nbuckets;
-  /* new buckets */
-  m->nbuckets = nbuckets;
-  m->buckets = malloc(sizeof(*m->buckets) * nbuckets);
-  if (m->buckets == NULL) return -1;
-  memset(m->buckets, 0, sizeof(*m->buckets) * m->nbuckets);
-  /* add all nodes to new buckets */
+static int hashset_resize(hashset *m, unsigned nslots) {
+  hashset_slot *old_slots = m->slots;
+  unsigned i = m->nslots;
+  hashset_slot *slots = calloc(nslots, sizeof(*slots));
+  if (slots == NULL) return -1;
+  m->slots = slots;
+  m->nslots = nslots;
+  /* Keys are unique, so just drop each in the first free slot */
   while (i--) {
-    node = old_buckets[i];
-    while (node) {
-      next = node->next;
-      int n = hashset_bucketidx(m, node->hash);
-      node->next = m->buckets[n];
-      m->buckets[n] = node;
-      node = next;
+    hashset_slot *s = &old_slots[i];
+    if (s->key) {
+      unsigned mask = nslots - 1, n = s->hash & mask;
+      while (slots[n].key)
+        n = (n + 1) & mask;
+      slots[n] = *s;
     }
   }
-  free(old_buckets);
+  free(old_slots);
   return 0;
 }
 
 int hashset_getlevel(hashset *m, const char *key) {
   /* a return level of -1 indicates non existing key */
-  unsigned hash = str_hash(key);
-  hashset_node *node;
-  if (m->nbuckets > 0) {
-    node = m->buckets[hashset_bucketidx(m, hash)];
-    while (node) {
-      if (node->hash == hash && !strcmp((char*) (node + 1), key)) {
-        return node->level;
-      }
-      node = node->next;
-    }
-  }
-  return -1;
+  size_t len;
+  hashset_slot *s;
+  if (m->nkeys == 0) return -1;
+  s = hashset_find(m, key, str_hash(key, &len));
+  return s->key ? s->level : -1;
 }
 
 void hashset_free(hashset *m) {
-  hashset_node *next, *node;
-  int i;
-  i = m->nbuckets;
-  while (i--) {
-    node = m->buckets[i];
-    while (node) {
-      next = node->next;
-      free(node);
-      node = next;
-    }
+  hashset_chunk *c = m->chunks, *next;
+  while (c) {
+    next = c->next;
+    free(c);
+    c = next;
   }
-  free(m->buckets);
+  free(m->slots);
+  hashset_init(m);
 }
 
 int hashset_add(hashset *m, const char *key, int level) {
   /* returns the current level for existing keys or -1 on error */
-  int n, err;
-  hashset_node *node;
-  int current_level = hashset_getlevel(m, key);
-  if(current_level >= 0) {
-  	return current_level;
-  }
-  /* Add new node */
-  node = hashset_newnode(key);
-  if (node == NULL) return -1;
-  if (m->nnodes >= m->nbuckets) {
-    n = (m->nbuckets > 0) ? (m->nbuckets << 1) : 1;
-    err = hashset_resize(m, n);
-    if (err) {
-	    free(node);
-	    return -1;
-	  }
+  size_t len;
+  unsigned hash = str_hash(key, &len);
+  hashset_slot *s;
+
+  /* Keep the table at most 3/4 full, so probes stay short */
+  if ((m->nkeys + 1) * 4 > m->nslots * 3) {
+    unsigned n = m->nslots ? m->nslots << 1 : HASHSET_INITIAL_SLOTS;
+    if (hashset_resize(m, n)) return -1;
   }
-  n = hashset_bucketidx(m, node->hash);
-  node->level = level;
-  node->next = m->buckets[n];
-  m->buckets[n] = node;
-  m->nnodes++;
+  s = hashset_find(m, key, hash);
+  if (s->key) return s->level;
+
+  if (!(s->key = hashset_copykey(m, key, len))) return -1;
+  s->hash = hash;
+  s->level = level;
+  m->nkeys++;
   return level;
 }
-
@@ -1,16 +1,34 @@
-typedef struct hashset_node {
-  struct hashset_node *next;
+#ifndef SQFS_HASHSET_H
+#define SQFS_HASHSET_H
+
+#include <stddef.h>
+
+/* Set of strings, each tagged with the level it was first added at. Used to
+ * merge directories across layers.
+ *
+ * Implementation
+ *	- Open addressing with linear probing. Slots keep each key's hash, so
+ *	  most mismatches are caught without touching the string.
+ *	- Keys are copied into large arena chunks, so a set costs a handful of
+ *	  allocations however many names it holds, and is freed all at once
+ */
+typedef struct hashset_chunk hashset_chunk;
+
+typedef struct {
+  const char *key;		/* NULL if empty */
   unsigned hash;
   int level;
-  /* char key[]; */
-} hashset_node;
+} hashset_slot;
 
 typedef struct {
-  hashset_node **buckets;
-  unsigned nbuckets, nnodes;
+  hashset_slot *slots;
+  unsigned nslots, nkeys;
+  hashset_chunk *chunks;
 } hashset;
 
 void hashset_init(hashset *m);
 int hashset_getlevel(hashset *m, const char *key);
 void hashset_free(hashset *m);
 int hashset_add(hashset *m, const char *key, int level);
+
+#endif
@@ -24,6 +24,8 @@
  */
 #include "squashfuse.h"
 #include "fuseprivate.h"
+#include "diskcache.h"
+#include "shmcache.h"
 #include "hashset.h"
 #include "stat.h"
 #include "nonstd.h"
@@ -361,6 +363,10 @@ int squash_main(int argc, char *argv[]) {
 	
 	struct fuse_opt fuse_opts[] = {
 		{"offset=%zu", offsetof(sqfs_opts, offset), 0},
+		{"preload_metadata", offsetof(sqfs_opts, preload_metadata), 1},
+		{"disk_cache=%s", offsetof(sqfs_opts, disk_cache), 0},
+		{"disk_cache_size=%u", offsetof(sqfs_opts, disk_cache_size), 0},
+		{"shm_cache=%u", offsetof(sqfs_opts, shm_cache_size), 0},
 		FUSE_OPT_END
 	};
 
@@ -389,6 +395,10 @@ int squash_main(int argc, char *argv[]) {
 	opts.images = malloc(argc * sizeof(char*)); /* enough room for all images */
 	opts.image_count = 0;
 	opts.offset = 0;
+	opts.preload_metadata = 0;
+	opts.disk_cache = NULL;
+	opts.disk_cache_size = SQFS_DISK_CACHE_SIZE;
+	opts.shm_cache_size = 0;
 	if (fuse_opt_parse(&args, &opts, fuse_opts, sqfs_opt_proc) == -1)
 		sqfs_usage(argv[0], true);
 	if (opts.image_count < 2)
@@ -404,6 +414,14 @@ int squash_main(int argc, char *argv[]) {
 	for(i=0; i<opts.image_count; i++) {
 		if(sqfs_hl_open(hl, opts.images[i], opts.offset)<0)
 			return -1;
+		if (opts.preload_metadata && sqfs_md_arena_load(&hl->fs))
+			fprintf(stderr, "Can't preload metadata, continuing without it.\n");
+		if (opts.disk_cache && sqfs_disk_cache_init(&hl->fs, opts.disk_cache,
+				(uint64_t)opts.disk_cache_size * 1024 * 1024))
+			fprintf(stderr, "Can't use disk cache, continuing without it.\n");
+		if (opts.shm_cache_size && sqfs_shm_cache_init(&hl->fs,
+				(uint64_t)opts.shm_cache_size * 1024 * 1024))
+			fprintf(stderr, "Can't use shared memory cache, continuing without it.\n");
 		hl++;
 	}
 	hl->fs.fd = 0;
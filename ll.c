@@ -25,16 +25,19 @@
 #include "ll.h"
 #include "fuseprivate.h"
 #include "stat.h"
+#include "trace.h"
 
 #include "nonstd.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <float.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <time.h>
 #include <unistd.h>
 
 static const double SQFS_TIMEOUT = DBL_MAX;
@@ -51,8 +54,56 @@ static time_t last_access = 0;
 static sig_atomic_t open_refcount = 0;
 /* same as lib/fuse_signals.c */
 static struct fuse_session *fuse_instance = NULL;
+/* what sqfs_ll_op_init asks the kernel for */
+static sqfs_ll_conn_opts conn_opts = { true, true, true };
+
+const char *const sqfs_ll_op_names[SQFS_LL_OP_COUNT] = {
+	"getattr", "opendir", "create", "releasedir", "readdir", "lookup", "open",
+	"release", "read", "readlink", "listxattr", "getxattr", "forget", "statfs",
+	"lseek",
+};
+
+/* Per-operation statistics. Latencies go in power-of-two buckets of
+ * microseconds: bucket i counts ops under 2^i us, the last one the rest. */
+#define SQFS_LL_LATENCY_BUCKETS 24
+
+typedef struct {
+	uint64_t count;
+	uint64_t nsec;			/* Total time spent */
+	uint64_t latency[SQFS_LL_LATENCY_BUCKETS];
+} sqfs_ll_op_stats;
+
+static sqfs_ll_op_stats op_stats[SQFS_LL_OP_COUNT];
+/* Where to dump statistics on SIGUSR1 */
+static sqfs_ll *stats_ll = NULL;
+static const char *stats_path = NULL;
+/* Where to record operations, see setup_trace */
+static FILE *trace_file = NULL;
+static struct timespec trace_start;
+
+static void sqfs_ll_op_begin(sqfs_ll_op op, struct timespec *start) {
+	SQFS_TRACE2(op__start, sqfs_ll_op_names[op], op);
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+static void sqfs_ll_op_end(sqfs_ll_op op, struct timespec *start) {
+	sqfs_ll_op_stats *st = &op_stats[op];
+	struct timespec end;
+	uint64_t nsec;
+	size_t i;
+	
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	nsec = (uint64_t)(end.tv_sec - start->tv_sec) * 1000000000
+		+ end.tv_nsec - start->tv_nsec;
+	for (i = 0; i < SQFS_LL_LATENCY_BUCKETS - 1 && (nsec / 1000) >> i; ++i)
+		;
+	++st->count;
+	st->nsec += nsec;
+	++st->latency[i];
+	SQFS_TRACE3(op__done, sqfs_ll_op_names[op], op, nsec);
+}
 
-void sqfs_ll_op_getattr(fuse_req_t req, fuse_ino_t ino,
+static void sqfs_ll_do_getattr(fuse_req_t req, fuse_ino_t ino,
 		struct fuse_file_info *fi) {
 	sqfs_ll_i lli;
 	struct stat st;
@@ -68,7 +119,7 @@ void sqfs_ll_op_getattr(fuse_req_t req, fuse_ino_t ino,
 	}
 }
 
-void sqfs_ll_op_opendir(fuse_req_t req, fuse_ino_t ino,
+static void sqfs_ll_do_opendir(fuse_req_t req, fuse_ino_t ino,
 		struct fuse_file_info *fi) {
 	sqfs_ll_i *lli;
 	last_access = time(NULL);
@@ -86,6 +137,13 @@ void sqfs_ll_op_opendir(fuse_req_t req, fuse_ino_t ino,
 			fuse_reply_err(req, ENOTDIR);
 		} else {
 			fi->fh = (intptr_t)lli;
+#if HAVE_STRUCT_FUSE_FILE_INFO_CACHE_READDIR
+			/* Nothing ever changes, so the kernel can keep listings */
+			if (conn_opts.cache_dir) {
+				fi->cache_readdir = 1;
+				fi->keep_cache = 1;
+			}
+#endif
 			++open_refcount;
 			fuse_reply_open(req, fi);
 			return;
@@ -94,13 +152,13 @@ void sqfs_ll_op_opendir(fuse_req_t req, fuse_ino_t ino,
 	free(lli);
 }
 
-void sqfs_ll_op_create(fuse_req_t req, fuse_ino_t parent, const char *name,
+static void sqfs_ll_do_create(fuse_req_t req, fuse_ino_t parent, const char *name,
 			      mode_t mode, struct fuse_file_info *fi) {
 	last_access = time(NULL);
 	fuse_reply_err(req, EROFS);
 }
 
-void sqfs_ll_op_releasedir(fuse_req_t req, fuse_ino_t ino,
+static void sqfs_ll_do_releasedir(fuse_req_t req, fuse_ino_t ino,
 		struct fuse_file_info *fi) {
 	last_access = time(NULL);
 	--open_refcount;
@@ -119,7 +177,7 @@ size_t sqfs_ll_add_direntry(fuse_req_t req, char *buf, size_t bufsize,
 		return esize;
 	#endif
 }
-void sqfs_ll_op_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
+static void sqfs_ll_do_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
 		off_t off, struct fuse_file_info *fi) {
 	sqfs_err sqerr;
 	sqfs_dir dir;
@@ -164,7 +222,7 @@ void sqfs_ll_op_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
 	free(buf);
 }
 
-void sqfs_ll_op_lookup(fuse_req_t req, fuse_ino_t parent,
+static void sqfs_ll_do_lookup(fuse_req_t req, fuse_ino_t parent,
 		const char *name) {
 	sqfs_ll_i lli;
 	sqfs_err sqerr;
@@ -218,9 +276,22 @@ void sqfs_ll_op_lookup(fuse_req_t req, fuse_ino_t parent,
 	}
 }
 
-void sqfs_ll_op_open(fuse_req_t req, fuse_ino_t ino,
+/* An open file, kept in fi->fh */
+typedef struct {
+	sqfs_inode inode;
+	bool raw_checked;	/* Whether raw is known yet */
+	bool raw;			/* Stored verbatim, see sqfs_file_stored_raw */
+	uint64_t raw_start;
+	bool has_stream;	/* One of the SQFS_LL_STREAMS */
+	sqfs_stream stream;
+} sqfs_ll_file;
+
+/* how many open files have a stream */
+static size_t stream_count = 0;
+
+static void sqfs_ll_do_open(fuse_req_t req, fuse_ino_t ino,
 		struct fuse_file_info *fi) {
-	sqfs_inode *inode;
+	sqfs_ll_file *file;
 	sqfs_ll *ll;
 	
 	last_access = time(NULL);
@@ -229,63 +300,182 @@ void sqfs_ll_op_open(fuse_req_t req, fuse_ino_t ino,
 		return;
 	}
 	
-	inode = malloc(sizeof(sqfs_inode));
-	if (!inode) {
+	file = malloc(sizeof(sqfs_ll_file));
+	if (!file) {
 		fuse_reply_err(req, ENOMEM);
 		return;
 	}
 	
 	ll = fuse_req_userdata(req);
-	if (sqfs_ll_inode(ll, inode, ino)) {
+	if (sqfs_ll_inode(ll, &file->inode, ino)) {
 		fuse_reply_err(req, ENOENT);
-	} else if (!S_ISREG(inode->base.mode)) {
+	} else if (!S_ISREG(file->inode.base.mode)) {
 		fuse_reply_err(req, EISDIR);
 	} else {
-		fi->fh = (intptr_t)inode;
+		file->raw_checked = false;
+		file->raw = false;
+		sqfs_stream_init(&file->stream);
+		file->has_stream = stream_count < SQFS_LL_STREAMS;
+		if (file->has_stream)
+			++stream_count;
+		fi->fh = (intptr_t)file;
 		fi->keep_cache = 1;
 		++open_refcount;
 		fuse_reply_open(req, fi);
 		return;
 	}
-	free(inode);
+	free(file);
 }
 
-void sqfs_ll_op_release(fuse_req_t req, fuse_ino_t ino,
+static void sqfs_ll_do_release(fuse_req_t req, fuse_ino_t ino,
 		struct fuse_file_info *fi) {
-	free((sqfs_inode*)(intptr_t)fi->fh);
+	sqfs_ll_file *file = (sqfs_ll_file*)(intptr_t)fi->fh;
+	if (file->has_stream) {
+		sqfs_stream_destroy(&file->stream);
+		--stream_count;
+	}
+	free(file);
 	fi->fh = 0;
 	last_access = time(NULL);
 	--open_refcount;
 	fuse_reply_err(req, 0);
 }
 
-void sqfs_ll_op_read(fuse_req_t req, fuse_ino_t ino,
+#if HAVE_DECL_FUSE_REPLY_DATA
+/* Find out if a file is stored verbatim. That walks its whole block list, so
+   wait until it's first read rather than doing it on every open. */
+static void sqfs_ll_check_raw(sqfs_ll *ll, sqfs_ll_file *file) {
+	file->raw = sqfs_file_stored_raw(&ll->fs, &file->inode, &file->raw_start);
+	file->raw_checked = true;
+	if (file->raw && file->has_stream) {
+		sqfs_stream_destroy(&file->stream);
+		file->has_stream = false;
+		--stream_count;
+	}
+}
+
+/* Let FUSE copy a file stored verbatim straight from the image, splicing it
+   into the kernel when it can */
+static void sqfs_ll_read_raw(fuse_req_t req, sqfs_ll *ll, sqfs_ll_file *file,
+		size_t size, off_t off) {
+	struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(0);
+	uint64_t file_size = file->inode.xtra.reg.file_size;
+	
+	if ((uint64_t)off >= file_size) {
+		fuse_reply_buf(req, NULL, 0);
+		return;
+	}
+	if (size > file_size - off)
+		size = (size_t)(file_size - off);
+	
+	bufv.buf[0].size = size;
+	bufv.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+	bufv.buf[0].fd = ll->fs.fd;
+	bufv.buf[0].pos = file->raw_start + off;
+	++ll->fs.stats.raw_reads;
+	ll->fs.stats.raw_bytes += size;
+	fuse_reply_data(req, &bufv, FUSE_BUF_SPLICE_MOVE);
+}
+#endif
+
+/* A block of zeros that every read points at for its holes. Allocated on the
+   first read, and kept. */
+static void *zero_block = NULL;
+
+/* Reply with the data in 'buf', and zero_block for the holes */
+static void sqfs_ll_reply_holes(fuse_req_t req, char *buf, size_t size,
+		sqfs_hole *holes, size_t nholes) {
+	struct iovec iov[2 * SQFS_LL_HOLES + 1];
+	size_t i, pos = 0;
+	int count = 0;
+	
+	for (i = 0; i < nholes; ++i) {
+		if (holes[i].off > pos) {
+			iov[count].iov_base = buf + pos;
+			iov[count++].iov_len = holes[i].off - pos;
+		}
+		iov[count].iov_base = zero_block;
+		iov[count++].iov_len = holes[i].size;
+		pos = holes[i].off + holes[i].size;
+	}
+	if (size > pos) {
+		iov[count].iov_base = buf + pos;
+		iov[count++].iov_len = size - pos;
+	}
+	fuse_reply_iov(req, iov, count);
+}
+
+static void sqfs_ll_do_read(fuse_req_t req, fuse_ino_t ino,
 		size_t size, off_t off, struct fuse_file_info *fi) {
 	sqfs_ll *ll = fuse_req_userdata(req);
-	sqfs_inode *inode = (sqfs_inode*)(intptr_t)fi->fh;
+	sqfs_ll_file *file = (sqfs_ll_file*)(intptr_t)fi->fh;
+	sqfs_inode *inode = &file->inode;
 	sqfs_err err = SQFS_OK;
 	
 	off_t osize;
-	char *buf = malloc(size);
-	if (!buf) {
+	char *buf;
+	sqfs_hole holes[SQFS_LL_HOLES];
+	size_t nholes;
+	
+	last_access = time(NULL);
+#if HAVE_DECL_FUSE_REPLY_DATA
+	if (!file->raw_checked)
+		sqfs_ll_check_raw(ll, file);
+	if (file->raw) {
+		sqfs_ll_read_raw(req, ll, file, size, off);
+		return;
+	}
+#endif
+	
+	if (!(buf = malloc(size))) {
 		fuse_reply_err(req, ENOMEM);
 		return;
 	}
 	
-	last_access = time(NULL);
+	if (!zero_block)
+		zero_block = calloc(1, ll->fs.sb.block_size);
+	nholes = zero_block ? SQFS_LL_HOLES : 0;
+	
 	osize = size;
-	err = sqfs_read_range(&ll->fs, inode, off, &osize, buf);
+	err = sqfs_read_range_holes(&ll->fs, inode,
+		file->has_stream ? &file->stream : NULL, off, &osize, buf,
+		holes, &nholes);
 	if (err) {
 		fuse_reply_err(req, EIO);
 	} else if (osize == 0) { /* EOF */
 		fuse_reply_buf(req, NULL, 0);
+	} else if (nholes) {
+		sqfs_ll_reply_holes(req, buf, osize, holes, nholes);
 	} else {
 		fuse_reply_buf(req, buf, osize);
 	}
 	free(buf);
 }
 
-void sqfs_ll_op_readlink(fuse_req_t req, fuse_ino_t ino) {
+#if HAVE_DECL_FUSE_REPLY_LSEEK
+static void sqfs_ll_do_lseek(fuse_req_t req, fuse_ino_t ino, off_t off,
+		int whence, struct fuse_file_info *fi) {
+	sqfs_ll *ll = fuse_req_userdata(req);
+	sqfs_ll_file *file = (sqfs_ll_file*)(intptr_t)fi->fh;
+	int hole = sqfs_seek_hole(whence);
+	sqfs_off_t pos;
+	
+	last_access = time(NULL);
+	if (hole == -1) {
+		fuse_reply_err(req, EINVAL);
+	} else if (off < 0 || (uint64_t)off >= file->inode.xtra.reg.file_size) {
+		fuse_reply_err(req, ENXIO);
+	} else if (sqfs_file_seek(&ll->fs, &file->inode, off, hole, &pos)) {
+		fuse_reply_err(req, EIO);
+	} else if (pos == -1) {
+		fuse_reply_err(req, ENXIO);
+	} else {
+		fuse_reply_lseek(req, pos);
+	}
+}
+#endif
+
+static void sqfs_ll_do_readlink(fuse_req_t req, fuse_ino_t ino) {
 	char *dst;
 	size_t size;
 	sqfs_ll_i lli;
@@ -308,7 +498,7 @@ void sqfs_ll_op_readlink(fuse_req_t req, fuse_ino_t ino) {
 	}
 }
 
-void sqfs_ll_op_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
+static void sqfs_ll_do_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
 	sqfs_ll_i lli;
 	char *buf;
 	int ferr;
@@ -334,7 +524,7 @@ void sqfs_ll_op_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
 	free(buf);
 }
 
-void sqfs_ll_op_getxattr(fuse_req_t req, fuse_ino_t ino,
+static void sqfs_ll_do_getxattr(fuse_req_t req, fuse_ino_t ino,
 		const char *name, size_t size
 #ifdef FUSE_XATTR_POSITION
 		, uint32_t position
@@ -370,7 +560,7 @@ void sqfs_ll_op_getxattr(fuse_req_t req, fuse_ino_t ino,
 	free(buf);
 }
 
-void sqfs_ll_op_forget(fuse_req_t req, fuse_ino_t ino,
+static void sqfs_ll_do_forget(fuse_req_t req, fuse_ino_t ino,
 		unsigned long nlookup) {
 	sqfs_ll_i lli;
 	last_access = time(NULL);
@@ -379,7 +569,7 @@ void sqfs_ll_op_forget(fuse_req_t req, fuse_ino_t ino,
 	fuse_reply_none(req);
 }
 
-void stfs_ll_op_statfs(fuse_req_t req, fuse_ino_t ino) {
+static void sqfs_ll_do_statfs(fuse_req_t req, fuse_ino_t ino) {
 	sqfs_ll *ll;
 	struct statvfs st;
 	int err;
@@ -393,6 +583,164 @@ void stfs_ll_op_statfs(fuse_req_t req, fuse_ino_t ino) {
 	}
 }
 
+/* Append an operation to the trace, in the format described in ll.h */
+static void sqfs_ll_record(sqfs_ll_op op, struct timespec *now, fuse_ino_t ino,
+		uint64_t a, uint64_t b, const char *name) {
+	int64_t nsec = (int64_t)(now->tv_sec - trace_start.tv_sec) * 1000000000
+		+ now->tv_nsec - trace_start.tv_nsec;
+	fprintf(trace_file, "%llu %s %llu %llu %llu", (unsigned long long)nsec / 1000,
+		sqfs_ll_op_names[op], (unsigned long long)ino, (unsigned long long)a,
+		(unsigned long long)b);
+	if (name) {
+		putc(' ', trace_file);
+		for (; *name; ++name) {
+			if (*name == '\\')
+				fputs("\\\\", trace_file);
+			else if (*name == '\n')
+				fputs("\\n", trace_file);
+			else
+				putc(*name, trace_file);
+		}
+	}
+	putc('\n', trace_file);
+}
+
+/* The handlers FUSE calls, which time the real ones and maybe record them.
+   'rec' is the inode, two numbers and a name to record. */
+#define SQFS_LL_RECORD_ARGS(ino, a, b, name) ino, a, b, name
+#define SQFS_LL_TIMED(name, op, params, args, rec) \
+	void sqfs_ll_op_##name params { \
+		struct timespec start; \
+		sqfs_ll_op_begin(op, &start); \
+		if (trace_file) \
+			sqfs_ll_record(op, &start, SQFS_LL_RECORD_ARGS rec); \
+		sqfs_ll_do_##name args; \
+		sqfs_ll_op_end(op, &start); \
+	}
+
+SQFS_LL_TIMED(getattr, SQFS_LL_OP_GETATTR,
+	(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi),
+	(req, ino, fi),
+	(ino, 0, 0, NULL))
+SQFS_LL_TIMED(opendir, SQFS_LL_OP_OPENDIR,
+	(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi),
+	(req, ino, fi),
+	(ino, 0, 0, NULL))
+SQFS_LL_TIMED(create, SQFS_LL_OP_CREATE,
+	(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode,
+		struct fuse_file_info *fi),
+	(req, parent, name, mode, fi),
+	(parent, 0, 0, name))
+SQFS_LL_TIMED(releasedir, SQFS_LL_OP_RELEASEDIR,
+	(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi),
+	(req, ino, fi),
+	(ino, 0, 0, NULL))
+SQFS_LL_TIMED(readdir, SQFS_LL_OP_READDIR,
+	(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+		struct fuse_file_info *fi),
+	(req, ino, size, off, fi),
+	(ino, off, size, NULL))
+SQFS_LL_TIMED(lookup, SQFS_LL_OP_LOOKUP,
+	(fuse_req_t req, fuse_ino_t parent, const char *name),
+	(req, parent, name),
+	(parent, 0, 0, name))
+SQFS_LL_TIMED(open, SQFS_LL_OP_OPEN,
+	(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi),
+	(req, ino, fi),
+	(ino, fi->flags, 0, NULL))
+SQFS_LL_TIMED(release, SQFS_LL_OP_RELEASE,
+	(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi),
+	(req, ino, fi),
+	(ino, 0, 0, NULL))
+SQFS_LL_TIMED(read, SQFS_LL_OP_READ,
+	(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+		struct fuse_file_info *fi),
+	(req, ino, size, off, fi),
+	(ino, off, size, NULL))
+SQFS_LL_TIMED(readlink, SQFS_LL_OP_READLINK,
+	(fuse_req_t req, fuse_ino_t ino),
+	(req, ino),
+	(ino, 0, 0, NULL))
+SQFS_LL_TIMED(listxattr, SQFS_LL_OP_LISTXATTR,
+	(fuse_req_t req, fuse_ino_t ino, size_t size),
+	(req, ino, size),
+	(ino, size, 0, NULL))
+#ifdef FUSE_XATTR_POSITION
+SQFS_LL_TIMED(getxattr, SQFS_LL_OP_GETXATTR,
+	(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size,
+		uint32_t position),
+	(req, ino, name, size, position),
+	(ino, size, 0, name))
+#else
+SQFS_LL_TIMED(getxattr, SQFS_LL_OP_GETXATTR,
+	(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size),
+	(req, ino, name, size),
+	(ino, size, 0, name))
+#endif
+SQFS_LL_TIMED(forget, SQFS_LL_OP_FORGET,
+	(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup),
+	(req, ino, nlookup),
+	(ino, nlookup, 0, NULL))
+#if HAVE_DECL_FUSE_REPLY_LSEEK
+SQFS_LL_TIMED(lseek, SQFS_LL_OP_LSEEK,
+	(fuse_req_t req, fuse_ino_t ino, off_t off, int whence,
+		struct fuse_file_info *fi),
+	(req, ino, off, whence, fi),
+	(ino, off, sqfs_seek_hole(whence), NULL))
+#endif
+
+void stfs_ll_op_statfs(fuse_req_t req, fuse_ino_t ino) {
+	struct timespec start;
+	sqfs_ll_op_begin(SQFS_LL_OP_STATFS, &start);
+	if (trace_file)
+		sqfs_ll_record(SQFS_LL_OP_STATFS, &start, ino, 0, 0, NULL);
+	sqfs_ll_do_statfs(req, ino);
+	sqfs_ll_op_end(SQFS_LL_OP_STATFS, &start);
+}
+
+#ifdef FUSE_CAP_ASYNC_READ
+static void sqfs_ll_want(struct fuse_conn_info *conn, unsigned cap) {
+	conn->want |= conn->capable & cap;
+}
+#endif
+
+void sqfs_ll_op_init(void *userdata, struct fuse_conn_info *conn) {
+	sqfs_ll *ll = userdata;
+	size_t block_size = ll->fs.sb.block_size;
+	
+	/* A read-only filesystem can take any requests in any order */
+#ifdef FUSE_CAP_ASYNC_READ
+	sqfs_ll_want(conn, FUSE_CAP_ASYNC_READ);
+#endif
+#ifdef FUSE_CAP_SPLICE_WRITE
+	sqfs_ll_want(conn, FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE);
+#endif
+#ifdef FUSE_CAP_PARALLEL_DIROPS
+	if (conn_opts.parallel_dirops)
+		sqfs_ll_want(conn, FUSE_CAP_PARALLEL_DIROPS);
+	else
+		conn->want &= ~FUSE_CAP_PARALLEL_DIROPS;
+#endif
+#ifdef FUSE_CAP_CACHE_SYMLINKS
+	if (conn_opts.cache_symlinks)
+		sqfs_ll_want(conn, FUSE_CAP_CACHE_SYMLINKS);
+#endif
+	
+	/* Options given by the user win */
+#if FUSE_USE_VERSION >= 30
+	if (conn_opts.fuse_opts)
+		fuse_apply_conn_info_opts(conn_opts.fuse_opts, conn);
+#endif
+	
+	/* We decompress whole blocks, so read ahead by whole blocks too */
+	if (conn->max_readahead >= block_size)
+		conn->max_readahead -= conn->max_readahead % block_size;
+}
+
+void setup_conn_opts(const sqfs_ll_conn_opts *opts) {
+	conn_opts = *opts;
+}
+
 /* Helpers to abstract out FUSE 2.5 vs 3.0+ differences */
 
 #if FUSE_USE_VERSION >= 30
@@ -522,6 +870,89 @@ void teardown_idle_timeout() {
 	fuse_instance = NULL;
 }
 
+/* Dump statistics on SIGUSR1. This runs in a signal handler, so it only uses
+   the async-signal-safe formatting in stats.h, and open/write/close. Counters
+   may be caught mid-update, which is fine for monitoring. */
+static void stats_dump(int sig) {
+	static char buf[32 * 1024];
+	sqfs_stats_buf b;
+	size_t i, j, done;
+	int fd = STDERR_FILENO;
+	
+	if (!stats_ll)
+		return;
+	
+	sqfs_stats_buf_init(&b, buf, sizeof(buf));
+	sqfs_stats_format(&stats_ll->fs, &b);
+	for (i = 0; i < SQFS_LL_OP_COUNT; ++i) {
+		sqfs_ll_op_stats *st = &op_stats[i];
+		if (!st->count)
+			continue;
+		sqfs_stats_str(&b, "op.");
+		sqfs_stats_put(&b, sqfs_ll_op_names[i], ".count", st->count);
+		sqfs_stats_str(&b, "op.");
+		sqfs_stats_put(&b, sqfs_ll_op_names[i], ".usec", st->nsec / 1000);
+		for (j = 0; j < SQFS_LL_LATENCY_BUCKETS; ++j) {
+			if (!st->latency[j])
+				continue;
+			sqfs_stats_str(&b, "op.");
+			sqfs_stats_str(&b, sqfs_ll_op_names[i]);
+			sqfs_stats_str(&b, ".usec_lt_");
+			if (j == SQFS_LL_LATENCY_BUCKETS - 1)
+				sqfs_stats_str(&b, "inf");
+			else
+				sqfs_stats_uint(&b, (uint64_t)1 << j);
+			sqfs_stats_str(&b, " ");
+			sqfs_stats_uint(&b, st->latency[j]);
+			sqfs_stats_str(&b, "\n");
+		}
+	}
+	
+	if (stats_path && (fd = open(stats_path, O_WRONLY | O_CREAT | O_TRUNC,
+			0644)) == -1)
+		return;
+	for (done = 0; done < b.len; ) {
+		ssize_t w = write(fd, b.buf + done, b.len - done);
+		if (w <= 0)
+			break;
+		done += w;
+	}
+	if (stats_path)
+		close(fd);
+}
+
+void setup_stats_dump(sqfs_ll *ll, const char *path) {
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(struct sigaction));
+	sa.sa_handler = stats_dump;
+	sigemptyset(&(sa.sa_mask));
+	sa.sa_flags = 0;
+	
+	stats_ll = ll;
+	stats_path = path;
+	if (sigaction(SIGUSR1, &sa, NULL) == -1)
+		perror("fuse: cannot set statistics signal handler");
+}
+
+void teardown_stats_dump() {
+	signal(SIGUSR1, SIG_DFL);
+	stats_ll = NULL;
+}
+
+sqfs_err setup_trace(const char *path) {
+	if (!(trace_file = fopen(path, "w")))
+		return SQFS_ERR;
+	clock_gettime(CLOCK_MONOTONIC, &trace_start);
+	fputs(SQFS_LL_TRACE_HEADER "\n", trace_file);
+	return SQFS_OK;
+}
+
+void teardown_trace() {
+	if (trace_file)
+		fclose(trace_file);
+	trace_file = NULL;
+}
+
 sqfs_ll *sqfs_ll_open(const char *path, size_t offset) {
 	sqfs_ll *ll;
 	
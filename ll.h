@@ -71,6 +71,29 @@ sqfs_err sqfs_ll_iget(fuse_req_t req, sqfs_ll_i *lli, fuse_ino_t i);
 
 int sqfs_ll_daemonize(int fg);
 
+/* How many open files may keep their own last data block (see sqfs_stream).
+   Others share the data cache. */
+#define SQFS_LL_STREAMS 64
+
+/* How many holes a read may answer from a shared block of zeros, rather than
+   zeroing its own buffer */
+#define SQFS_LL_HOLES 32
+
+/* Capabilities to ask for in sqfs_ll_op_init */
+typedef struct {
+	bool cache_dir;			/* Let the kernel cache directory listings */
+	bool cache_symlinks;
+	bool parallel_dirops;	/* Allow concurrent lookups in one directory */
+#if FUSE_USE_VERSION >= 30
+	/* From fuse_parse_conn_info_opts, applied over our own choices */
+	struct fuse_conn_info_opts *fuse_opts;
+#endif
+} sqfs_ll_conn_opts;
+
+void setup_conn_opts(const sqfs_ll_conn_opts *opts);
+
+void sqfs_ll_op_init(void *userdata, struct fuse_conn_info *conn);
+
 void sqfs_ll_op_getattr(fuse_req_t req, fuse_ino_t ino,
 	struct fuse_file_info *fi);
 
@@ -117,6 +140,12 @@ void sqfs_ll_op_forget(fuse_req_t req, fuse_ino_t ino,
 
 void stfs_ll_op_statfs(fuse_req_t req, fuse_ino_t ino);
 
+#if HAVE_DECL_FUSE_REPLY_LSEEK
+/* SEEK_DATA and SEEK_HOLE, so sparse files can be copied efficiently */
+void sqfs_ll_op_lseek(fuse_req_t req, fuse_ino_t ino, off_t off, int whence,
+		struct fuse_file_info *fi);
+#endif
+
 
 /* Helpers to abstract out FUSE 2.5 vs 3.0+ differences */
 
@@ -144,6 +173,50 @@ void setup_idle_timeout(struct fuse_session *se, unsigned int timeout_secs);
 
 void teardown_idle_timeout();
 
+/* Dump runtime statistics (see stats.h) on SIGUSR1, to 'path' or to stderr
+   if it's NULL */
+void setup_stats_dump(sqfs_ll *ll, const char *path);
+
+void teardown_stats_dump();
+
+/* The operations in traces and statistics */
+typedef enum {
+	SQFS_LL_OP_GETATTR,
+	SQFS_LL_OP_OPENDIR,
+	SQFS_LL_OP_CREATE,
+	SQFS_LL_OP_RELEASEDIR,
+	SQFS_LL_OP_READDIR,
+	SQFS_LL_OP_LOOKUP,
+	SQFS_LL_OP_OPEN,
+	SQFS_LL_OP_RELEASE,
+	SQFS_LL_OP_READ,
+	SQFS_LL_OP_READLINK,
+	SQFS_LL_OP_LISTXATTR,
+	SQFS_LL_OP_GETXATTR,
+	SQFS_LL_OP_FORGET,
+	SQFS_LL_OP_STATFS,
+	SQFS_LL_OP_LSEEK,
+	SQFS_LL_OP_COUNT
+} sqfs_ll_op;
+
+/* Their names, as in traces and statistics */
+extern const char *const sqfs_ll_op_names[SQFS_LL_OP_COUNT];
+
+/* Record every operation to 'path', for squashfuse_replay. The first line is
+   SQFS_LL_TRACE_HEADER, then each operation is a line:
+	USEC OP INO A B [NAME]
+   USEC is microseconds since recording started, OP the name of the operation
+   as in the statistics, and INO the inode or parent. A and B are the offset
+   and size for read and readdir, the size for listxattr and getxattr, the
+   count for forget and the flags for open, and zero otherwise. For lseek,
+   A is the offset and B is 1 for SEEK_HOLE, 0 for SEEK_DATA. NAME is given
+   for lookup, create and getxattr, with backslash and newline escaped as \\
+   and \n. */
+#define SQFS_LL_TRACE_HEADER "# squashfuse trace 1"
+sqfs_err setup_trace(const char *path);
+
+void teardown_trace();
+
 sqfs_ll *sqfs_ll_open(const char *path, size_t offset);
 
 
@@ -370,7 +370,7 @@ sqfs_err sqfs_ll_stat(sqfs_ll *ll, sqfs_inode *inode, struct stat *st) {
 	if (S_ISREG(st->st_mode)) {
 		/* FIXME: do symlinks, dirs, etc have a size? */
 		st->st_size = inode->xtra.reg.file_size;
-		st->st_blocks = st->st_size / 512;
+		st->st_blocks = sqfs_file_blocks(inode);
 	} else if (S_ISBLK(st->st_mode) || S_ISCHR(st->st_mode)) {
 		st->st_rdev = sqfs_makedev(inode->xtra.dev.major,
 			inode->xtra.dev.minor);
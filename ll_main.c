@@ -24,6 +24,8 @@
  */
 #include "ll.h"
 #include "fuseprivate.h"
+#include "diskcache.h"
+#include "shmcache.h"
 #include "stat.h"
 
 #include "nonstd.h"
@@ -40,6 +42,7 @@
 int main(int argc, char *argv[]) {
 	struct fuse_args args;
 	sqfs_opts opts;
+	sqfs_ll_conn_opts conn_opts;
 
 #if FUSE_USE_VERSION >= 30
 	struct fuse_cmdline_opts fuse_cmdline_opts;
@@ -52,14 +55,25 @@ int main(int argc, char *argv[]) {
 	
 	int err;
 	sqfs_ll *ll;
+	char *stats_file = NULL;
 	struct fuse_opt fuse_opts[] = {
 		{"offset=%zu", offsetof(sqfs_opts, offset), 0},
 		{"timeout=%u", offsetof(sqfs_opts, idle_timeout_secs), 0},
+		{"preload_metadata", offsetof(sqfs_opts, preload_metadata), 1},
+		{"disk_cache=%s", offsetof(sqfs_opts, disk_cache), 0},
+		{"disk_cache_size=%u", offsetof(sqfs_opts, disk_cache_size), 0},
+		{"shm_cache=%u", offsetof(sqfs_opts, shm_cache_size), 0},
+		{"stats_file=%s", offsetof(sqfs_opts, stats_file), 0},
+		{"trace_file=%s", offsetof(sqfs_opts, trace_file), 0},
+		{"no_cache_dir", offsetof(sqfs_opts, no_cache_dir), 1},
+		{"no_cache_symlinks", offsetof(sqfs_opts, no_cache_symlinks), 1},
+		{"no_parallel_dirops", offsetof(sqfs_opts, no_parallel_dirops), 1},
 		FUSE_OPT_END
 	};
 	
 	struct fuse_lowlevel_ops sqfs_ll_ops;
 	memset(&sqfs_ll_ops, 0, sizeof(sqfs_ll_ops));
+	sqfs_ll_ops.init		= sqfs_ll_op_init;
 	sqfs_ll_ops.getattr		= sqfs_ll_op_getattr;
 	sqfs_ll_ops.opendir		= sqfs_ll_op_opendir;
 	sqfs_ll_ops.releasedir	= sqfs_ll_op_releasedir;
@@ -74,6 +88,9 @@ int main(int argc, char *argv[]) {
 	sqfs_ll_ops.getxattr	= sqfs_ll_op_getxattr;
 	sqfs_ll_ops.forget		= sqfs_ll_op_forget;
 	sqfs_ll_ops.statfs    = stfs_ll_op_statfs;
+#if HAVE_DECL_FUSE_REPLY_LSEEK
+	sqfs_ll_ops.lseek		= sqfs_ll_op_lseek;
+#endif
    
 	/* PARSE ARGS */
 	args.argc = argc;
@@ -85,6 +102,15 @@ int main(int argc, char *argv[]) {
 	opts.image_count = 0;
 	opts.offset = 0;
 	opts.idle_timeout_secs = 0;
+	opts.preload_metadata = 0;
+	opts.disk_cache = NULL;
+	opts.disk_cache_size = SQFS_DISK_CACHE_SIZE;
+	opts.shm_cache_size = 0;
+	opts.stats_file = NULL;
+	opts.trace_file = NULL;
+	opts.no_cache_dir = 0;
+	opts.no_cache_symlinks = 0;
+	opts.no_parallel_dirops = 0;
 	if (fuse_opt_parse(&args, &opts, fuse_opts, sqfs_opt_proc) == -1)
 		sqfs_usage(argv[0], true);
     if(opts.image_count != 2)
@@ -103,6 +129,17 @@ int main(int argc, char *argv[]) {
 	if (fuse_cmdline_opts.mountpoint == NULL)
 		sqfs_usage(argv[0], true);
 
+	conn_opts.cache_dir = !opts.no_cache_dir;
+	conn_opts.cache_symlinks = !opts.no_cache_symlinks;
+	conn_opts.parallel_dirops = !opts.no_parallel_dirops;
+#if FUSE_USE_VERSION >= 30
+	/* libfuse's own max_readahead=, sync_read, no_splice_write etc. Older
+	   versions handle these themselves. */
+	if (!(conn_opts.fuse_opts = fuse_parse_conn_info_opts(&args)))
+		sqfs_usage(argv[0], true);
+#endif
+	setup_conn_opts(&conn_opts);
+
 	/* fuse_daemonize() will unconditionally clobber fds 0-2.
 	 *
 	 * If we get one of these file descriptors in sqfs_ll_open,
@@ -128,6 +165,20 @@ int main(int argc, char *argv[]) {
 
 	/* OPEN FS */
 	err = !(ll = sqfs_ll_open(opts.images[0], opts.offset));
+	if (!err && opts.preload_metadata && sqfs_md_arena_load(&ll->fs))
+		fprintf(stderr, "Can't preload metadata, continuing without it.\n");
+	if (!err && opts.disk_cache && sqfs_disk_cache_init(&ll->fs,
+			opts.disk_cache, (uint64_t)opts.disk_cache_size * 1024 * 1024))
+		fprintf(stderr, "Can't use disk cache, continuing without it.\n");
+	if (!err && opts.shm_cache_size && sqfs_shm_cache_init(&ll->fs,
+			(uint64_t)opts.shm_cache_size * 1024 * 1024))
+		fprintf(stderr, "Can't use shared memory cache, continuing without it.\n");
+	/* Before daemonizing, so a relative path works */
+	if (!err && opts.trace_file && (err = setup_trace(opts.trace_file)))
+		perror("Can't open trace file");
+	if (!err && opts.stats_file
+			&& (err = !(stats_file = sqfs_abs_path(opts.stats_file))))
+		perror("Can't resolve statistics file path");
 	
 	/* STARTUP FUSE */
 	if (!err) {
@@ -145,8 +196,10 @@ int main(int argc, char *argv[]) {
 					if (opts.idle_timeout_secs) {
 						setup_idle_timeout(ch.session, opts.idle_timeout_secs);
 					}
+					setup_stats_dump(ll, stats_file);
 					/* FIXME: multithreading */
 					err = fuse_session_loop(ch.session);
+					teardown_stats_dump();
 					teardown_idle_timeout();
 					fuse_remove_signal_handlers(ch.session);
 				}
@@ -155,8 +208,13 @@ int main(int argc, char *argv[]) {
 			sqfs_ll_unmount(&ch, fuse_cmdline_opts.mountpoint);
 		}
 	}
+	teardown_trace();
 	fuse_opt_free_args(&args);
+#if FUSE_USE_VERSION >= 30
+	free(conn_opts.fuse_opts);
+#endif
 	free(ll);
+	free(stats_file);
 	free(fuse_cmdline_opts.mountpoint);
 	
 	return -err;
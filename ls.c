@@ -27,6 +27,9 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 
 
 #define PROGNAME "squashfuse_ls"
@@ -35,9 +38,21 @@
 #define ERR_USAGE	(-2)
 #define ERR_OPEN	(-3)
 
+/* Output is collected here and written in large chunks */
+#define OUT_BUF_SIZE (256 * 1024)
+
+typedef enum {
+	LS_PATHS,
+	LS_LONG,
+	LS_JSON
+} ls_format;
+
 static void usage() {
 	fprintf(stderr, "%s (c) 2013 Dave Vasilevsky\n\n", PROGNAME);
-	fprintf(stderr, "Usage: %s ARCHIVE\n", PROGNAME);
+	fprintf(stderr, "Usage: %s [-l | -j] [-0] ARCHIVE\n", PROGNAME);
+	fprintf(stderr, "  -l  long listing: mode, links, uid, gid, size, mtime (UTC), path\n");
+	fprintf(stderr, "  -j  one JSON object per line, with inode number and data location\n");
+	fprintf(stderr, "  -0  end each entry with NUL instead of newline\n");
 	exit(ERR_USAGE);
 }
 
@@ -46,30 +61,328 @@ static void die(const char *msg) {
 	exit(ERR_MISC);
 }
 
+static struct {
+	char buf[OUT_BUF_SIZE];
+	size_t used;
+} out;
+
+static void out_flush(void) {
+	if (out.used && fwrite(out.buf, 1, out.used, stdout) != out.used)
+		die("write error");
+	out.used = 0;
+}
+
+static void out_mem(const char *s, size_t size) {
+	if (size > sizeof(out.buf) - out.used) {
+		out_flush();
+		if (size > sizeof(out.buf)) {
+			if (fwrite(s, 1, size, stdout) != size)
+				die("write error");
+			return;
+		}
+	}
+	memcpy(out.buf + out.used, s, size);
+	out.used += size;
+}
+
+static void out_str(const char *s) {
+	out_mem(s, strlen(s));
+}
+
+static void out_char(char c) {
+	if (out.used == sizeof(out.buf))
+		out_flush();
+	out.buf[out.used++] = c;
+}
+
+static void out_uint(uint64_t n) {
+	char digits[20];
+	size_t i = sizeof(digits);
+	do {
+		digits[--i] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	out_mem(digits + i, sizeof(digits) - i);
+}
+
+/* Names are bytes, not necessarily UTF-8. Escape just what JSON requires. */
+static void out_json_str(const char *s, size_t size) {
+	static const char hex[] = "0123456789abcdef";
+	size_t i, start = 0;
+	
+	out_char('"');
+	for (i = 0; i < size; ++i) {
+		unsigned char c = s[i];
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		out_mem(s + start, i - start);
+		start = i + 1;
+		switch (c) {
+			case '"': out_str("\\\""); break;
+			case '\\': out_str("\\\\"); break;
+			case '\n': out_str("\\n"); break;
+			case '\t': out_str("\\t"); break;
+			default:
+				out_str("\\u00");
+				out_char(hex[c >> 4]);
+				out_char(hex[c & 0xf]);
+		}
+	}
+	out_mem(s + start, size - start);
+	out_char('"');
+}
+
+/* Everything we print about an inode, decoded once */
+typedef struct {
+	sqfs_inode inode;
+	sqfs_id_t uid, gid;
+	uint64_t size;
+	char *target;		/* Symlinks only */
+} ls_item;
+
+/* The id table is tiny, so look up every id just once */
+static struct {
+	sqfs_id_t *ids;
+	size_t count;
+} id_cache;
+
+static void id_cache_init(sqfs *fs) {
+	size_t i;
+	id_cache.count = fs->sb.no_ids;
+	if (!(id_cache.ids = malloc(id_cache.count * sizeof(*id_cache.ids) + 1)))
+		die("malloc error");
+	for (i = 0; i < id_cache.count; ++i) {
+		if (sqfs_id_get(fs, i, &id_cache.ids[i]))
+			die("sqfs_id_get error");
+	}
+}
+
+static sqfs_id_t id_cache_get(uint16_t idx) {
+	if (idx >= id_cache.count)
+		die("bad uid or gid index");
+	return id_cache.ids[idx];
+}
+
+static void ls_item_get(sqfs *fs, sqfs_inode_id iid, ls_item *item) {
+	static char *target;
+	static size_t target_cap;
+	sqfs_inode *inode = &item->inode;
+	
+	if (sqfs_inode_get(fs, inode, iid))
+		die("sqfs_inode_get error");
+	item->uid = id_cache_get(inode->base.uid);
+	item->gid = id_cache_get(inode->base.guid);
+	item->target = NULL;
+	item->size = 0;
+	
+	if (S_ISREG(inode->base.mode)) {
+		item->size = inode->xtra.reg.file_size;
+	} else if (S_ISDIR(inode->base.mode)) {
+		item->size = inode->xtra.dir.dir_size;
+	} else if (S_ISLNK(inode->base.mode)) {
+		size_t size = inode->xtra.symlink_size + 1;
+		if (size > target_cap) {
+			free(target);
+			if (!(target = malloc(size)))
+				die("malloc error");
+			target_cap = size;
+		}
+		if (sqfs_readlink(fs, inode, target, &size))
+			die("sqfs_readlink error");
+		item->target = target;
+		item->size = inode->xtra.symlink_size;
+	}
+}
+
+static char ls_type_char(sqfs_mode_t mode) {
+	if (S_ISDIR(mode)) return 'd';
+	if (S_ISLNK(mode)) return 'l';
+	if (S_ISBLK(mode)) return 'b';
+	if (S_ISCHR(mode)) return 'c';
+	if (S_ISFIFO(mode)) return 'p';
+	if (S_ISSOCK(mode)) return 's';
+	return '-';
+}
+
+static const char *ls_type_name(sqfs_mode_t mode) {
+	if (S_ISDIR(mode)) return "dir";
+	if (S_ISLNK(mode)) return "symlink";
+	if (S_ISBLK(mode)) return "block";
+	if (S_ISCHR(mode)) return "char";
+	if (S_ISFIFO(mode)) return "fifo";
+	if (S_ISSOCK(mode)) return "socket";
+	return "file";
+}
+
+static void out_mode(sqfs_mode_t mode) {
+	static const char rwx[] = "rwxrwxrwx";
+	char str[10];
+	int i;
+	
+	str[0] = ls_type_char(mode);
+	for (i = 0; i < 9; ++i)
+		str[i + 1] = (mode & (0400 >> i)) ? rwx[i] : '-';
+	/* setuid, setgid and sticky, as stored in the image */
+	if (mode & 04000)
+		str[3] = (mode & 0100) ? 's' : 'S';
+	if (mode & 02000)
+		str[6] = (mode & 0010) ? 's' : 'S';
+	if (mode & 01000)
+		str[9] = (mode & 0001) ? 't' : 'T';
+	out_mem(str, sizeof(str));
+}
+
+/* Most entries in an image share a handful of mtimes */
+static void out_time(uint32_t mtime) {
+	static char str[32];
+	static uint32_t last;
+	static bool valid;
+	
+	if (!valid || mtime != last) {
+		time_t t = mtime;
+		struct tm *tm = gmtime(&t);
+		if (!tm || !strftime(str, sizeof(str), "%Y-%m-%d %H:%M:%S", tm))
+			strcpy(str, "?");
+		last = mtime;
+		valid = true;
+	}
+	out_str(str);
+}
+
+static void ls_long(ls_item *item, const char *path) {
+	sqfs_inode *inode = &item->inode;
+	
+	out_mode(inode->base.mode);
+	out_char(' ');
+	out_uint(inode->nlink);
+	out_char(' ');
+	out_uint(item->uid);
+	out_char(' ');
+	out_uint(item->gid);
+	out_char(' ');
+	if (S_ISBLK(inode->base.mode) || S_ISCHR(inode->base.mode)) {
+		out_uint(inode->xtra.dev.major);
+		out_str(", ");
+		out_uint(inode->xtra.dev.minor);
+	} else {
+		out_uint(item->size);
+	}
+	out_char(' ');
+	out_time(inode->base.mtime);
+	out_char(' ');
+	out_str(path);
+	if (item->target) {
+		out_str(" -> ");
+		out_str(item->target);
+	}
+}
+
+static void ls_json(ls_item *item, const char *path) {
+	sqfs_inode *inode = &item->inode;
+	sqfs_mode_t mode = inode->base.mode;
+	
+	out_str("{\"path\":");
+	out_json_str(path, strlen(path));
+	out_str(",\"type\":\"");
+	out_str(ls_type_name(mode));
+	out_str("\",\"mode\":");
+	out_uint(mode & 07777);
+	out_str(",\"uid\":");
+	out_uint(item->uid);
+	out_str(",\"gid\":");
+	out_uint(item->gid);
+	out_str(",\"size\":");
+	out_uint(item->size);
+	out_str(",\"mtime\":");
+	out_uint(inode->base.mtime);
+	out_str(",\"inode\":");
+	out_uint(inode->base.inode_number);
+	out_str(",\"nlink\":");
+	out_uint(inode->nlink);
+	
+	if (S_ISREG(mode)) {
+		out_str(",\"start_block\":");
+		out_uint(inode->xtra.reg.start_block);
+		if (inode->xtra.reg.frag_idx == SQUASHFS_INVALID_FRAG) {
+			out_str(",\"fragment\":null");
+		} else {
+			out_str(",\"fragment\":");
+			out_uint(inode->xtra.reg.frag_idx);
+			out_str(",\"fragment_offset\":");
+			out_uint(inode->xtra.reg.frag_off);
+		}
+	} else if (S_ISBLK(mode) || S_ISCHR(mode)) {
+		out_str(",\"major\":");
+		out_uint(inode->xtra.dev.major);
+		out_str(",\"minor\":");
+		out_uint(inode->xtra.dev.minor);
+	} else if (item->target) {
+		out_str(",\"target\":");
+		out_json_str(item->target, strlen(item->target));
+	}
+	out_char('}');
+}
+
 int main(int argc, char *argv[]) {
 	sqfs_err err = SQFS_OK;
 	sqfs_traverse trv;
 	sqfs fs;
 	char *image;
+	ls_format format = LS_PATHS;
+	char end = '\n';
+	ls_item item;
 
+	while (argc > 1 && argv[1][0] == '-' && argv[1][1]) {
+		if (strcmp(argv[1], "-l") == 0)
+			format = LS_LONG;
+		else if (strcmp(argv[1], "-j") == 0)
+			format = LS_JSON;
+		else if (strcmp(argv[1], "-0") == 0)
+			end = '\0';
+		else
+			usage();
+		++argv;
+		--argc;
+	}
 	if (argc != 2)
 		usage();
 	image = argv[1];
 
 	if ((err = sqfs_open_image(&fs, image, 0)))
 		exit(ERR_OPEN);
+	if (format != LS_PATHS)
+		id_cache_init(&fs);
 	
-	if ((err = sqfs_traverse_open(&trv, &fs, sqfs_inode_root(&fs))))
+	if ((err = sqfs_traverse_open_lazy(&trv, &fs, sqfs_inode_root(&fs))))
 		die("sqfs_traverse_open error");
 	while (sqfs_traverse_next(&trv, &err)) {
 		if (!trv.dir_end) {
-			printf("%s\n", trv.path);
+			const char *path;
+			if ((err = sqfs_traverse_path(&trv, &path)))
+				die("sqfs_traverse_path error");
+			switch (format) {
+				case LS_PATHS:
+					out_str(path);
+					break;
+				case LS_LONG:
+					ls_item_get(&fs, sqfs_dentry_inode(&trv.entry), &item);
+					ls_long(&item, path);
+					break;
+				case LS_JSON:
+					ls_item_get(&fs, sqfs_dentry_inode(&trv.entry), &item);
+					ls_json(&item, path);
+					break;
+			}
+			out_char(end);
 		}
 	}
 	if (err)
 		die("sqfs_traverse_next error");
 	sqfs_traverse_close(&trv);
 	
+	out_flush();
+	if (fflush(stdout))
+		die("write error");
 	sqfs_fd_close(fs.fd);
 	return 0;
 }
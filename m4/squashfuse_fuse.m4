@@ -256,6 +256,13 @@ AC_DEFUN([SQ_FUSE_API_VERSION],[
 
 		AC_CHECK_DECLS([fuse_session_remove_chan],,,
 			[#include <fuse_lowlevel.h>])
+
+		AC_CHECK_DECLS([fuse_reply_data],,,
+			[#include <fuse_lowlevel.h>])
+		AC_CHECK_MEMBERS([struct fuse_file_info.cache_readdir],,,
+			[#include <fuse_lowlevel.h>])
+		AC_CHECK_DECLS([fuse_reply_lseek],,,
+			[#include <fuse_lowlevel.h>])
 	
 		AC_CACHE_CHECK([for two-argument fuse_unmount],
 				[sq_cv_decl_fuse_unmount_two_arg],[
@@ -99,6 +99,7 @@ AS_IF([test "x$sq_cv_decl_makedev_qnx" = xyes],
 # SQ_CHECK_DECL_ENOATTR([IF_NOT_FOUND]) - ENOATTR error code
 # SQ_CHECK_DECL_DAEMON		- daemon() in unistd.h
 # SQ_CHECK_DECL_SYMLINK   - symlink() in unistd.h
+# SQ_CHECK_DECL_SEEK_DATA([IF_NOT_FOUND]) - SEEK_DATA and SEEK_HOLE
 
 AC_DEFUN([SQ_CHECK_DECL_MAKEDEV],[
 SQ_CHECK_DECL_MAKEDEV_QNX([
@@ -137,3 +138,45 @@ AC_DEFUN([SQ_CHECK_DECL_DAEMON],
 	[SQ_CHECK_NONSTD(daemon,[#include <unistd.h>],[(void)daemon;])])
 AC_DEFUN([SQ_CHECK_DECL_SYMLINK],
 	[SQ_CHECK_NONSTD(symlink,[#include <unistd.h>],[(void)symlink;])])
+AC_DEFUN([SQ_CHECK_DECL_SEEK_DATA],
+	[SQ_CHECK_NONSTD(SEEK_DATA,[#include <unistd.h>],
+		[int w = SEEK_DATA + SEEK_HOLE;],[$1])])
+
+# SQ_CHECK_SHM_CACHE
+#
+# Check for POSIX shared memory and GCC-style atomics, needed by the shared
+# memory block cache.
+AC_DEFUN([SQ_CHECK_SHM_CACHE],[
+AC_SEARCH_LIBS([shm_open],[rt])
+AC_CACHE_CHECK([for shared memory cache support], [sq_cv_shm_cache],[
+	sq_cv_shm_cache=no
+	AC_LINK_IFELSE([AC_LANG_PROGRAM([
+		#include <sys/mman.h>
+		#include <stdint.h>
+	],[
+		uint32_t v = 0;
+		(void)shm_open;
+		(void)mmap;
+		__atomic_compare_exchange_n(&v, &v, 1, 0, __ATOMIC_ACQUIRE,
+			__ATOMIC_RELAXED);
+		return (int)__atomic_load_n(&v, __ATOMIC_ACQUIRE);
+	])],[sq_cv_shm_cache=yes])
+])
+AS_IF([test "x$sq_cv_shm_cache" = xyes],
+	[AC_DEFINE([HAVE_SHM_CACHE],[1],
+		[Define if the shared memory block cache is supported])])
+])
+
+# SQ_CHECK_PTHREAD
+#
+# Check for POSIX threads, used by parallel traversal and the demo extractor.
+# Sets PTHREAD_LIBS.
+AC_DEFUN([SQ_CHECK_PTHREAD],[
+SQ_SAVE_FLAGS
+AC_CHECK_HEADERS([pthread.h],[
+	AC_SEARCH_LIBS([pthread_create],[pthread],[
+		AC_DEFINE([HAVE_PTHREAD],[1],[Define if POSIX threads are available])
+	])
+])
+SQ_KEEP_FLAGS([PTHREAD],[yes])
+])
@@ -26,6 +26,7 @@
 #include "config.h"
 #include "fs.h"
 #include "crypto.h"
+#include "trace.h"
 
 #ifdef _WIN32
 	#include "win32.h"
@@ -54,7 +55,12 @@
 #endif
 
 ssize_t sqfs_pread(sqfs *fs, void *buf, size_t count, sqfs_off_t off) {
+	SQFS_TRACE2(pread__start, off, count);
 	count = sqfs_pread_raw(fs->fd, buf, count, off + fs->offset);
+	SQFS_TRACE2(pread__done, off, (ssize_t)count);
+	++fs->stats.pread_calls;
+	if ((ssize_t)count > 0)
+		fs->stats.pread_bytes += count;
 	if(fs->crypto != NULL) {
 		crypt_decrypt(fs, buf, count, off);
     }
@@ -37,6 +37,10 @@ ssize_t sqfs_pread(sqfs *fd, void *buf, size_t count, sqfs_off_t off);
 
 int sqfs_enoattr();
 
+/* 1 for SEEK_HOLE, 0 for SEEK_DATA, -1 for anything else or if the system
+   has neither */
+int sqfs_seek_hole(int whence);
+
 int sqfs_symlink(const char *target, const char *linkpath);
 
 #endif
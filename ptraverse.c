@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ptraverse.h"
+
+#include "fs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#define PTRAVERSE_LOCK(m) pthread_mutex_lock(m)
+#define PTRAVERSE_UNLOCK(m) pthread_mutex_unlock(m)
+#define PTRAVERSE_WAIT(c, m) pthread_cond_wait(c, m)
+#define PTRAVERSE_WAKE(c) pthread_cond_broadcast(c)
+#else
+#define PTRAVERSE_LOCK(m)
+#define PTRAVERSE_UNLOCK(m)
+#define PTRAVERSE_WAIT(c, m)
+#define PTRAVERSE_WAKE(c)
+#endif
+
+#define PTRAVERSE_PATH_SEPARATOR '/'
+
+/* Initial capacity of each thread's deque */
+#define PTRAVERSE_DEFAULT_TASKS 64
+
+/* A directory waiting to be read */
+typedef struct {
+	sqfs_inode_id inode;
+	char *path;
+} sqfs_ptraverse_task;
+
+typedef struct sqfs_ptraverse_pool sqfs_ptraverse_pool;
+
+typedef struct {
+	sqfs_ptraverse_pool *pool;
+	sqfs *fs;
+	sqfs clone;
+	bool started;
+
+	sqfs_ptraverse_task *tasks;
+	size_t head, tail, cap;		/* Waiting tasks are [head, tail) */
+
+	char *path;
+	size_t path_cap;
+	sqfs_name namebuf;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t lock;
+	pthread_t thread;
+#endif
+} sqfs_ptraverse_worker;
+
+struct sqfs_ptraverse_pool {
+	sqfs_ptraverse_fn fn;
+	void *data;
+	sqfs_ptraverse_worker *workers;
+	size_t nworkers;
+
+	/* Tasks waiting in all the deques. A task is counted just after it's
+	   pushed, so a thief can make this dip below zero for a moment. */
+	long queued;
+	size_t busy;			/* Threads reading a directory */
+	sqfs_err err;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+#endif
+};
+
+
+static sqfs_err sqfs_ptraverse_push(sqfs_ptraverse_worker *w,
+		sqfs_inode_id inode, char *path) {
+	sqfs_ptraverse_pool *pool = w->pool;
+	sqfs_err err = SQFS_OK;
+
+	PTRAVERSE_LOCK(&w->lock);
+	if (w->tail == w->cap) {
+		if (w->head > 0) {
+			memmove(w->tasks, w->tasks + w->head,
+				(w->tail - w->head) * sizeof(*w->tasks));
+			w->tail -= w->head;
+			w->head = 0;
+		} else {
+			size_t cap = w->cap ? w->cap * 2 : PTRAVERSE_DEFAULT_TASKS;
+			sqfs_ptraverse_task *tasks = realloc(w->tasks, cap * sizeof(*tasks));
+			if (tasks) {
+				w->tasks = tasks;
+				w->cap = cap;
+			} else {
+				err = SQFS_ERR;
+			}
+		}
+	}
+	if (!err) {
+		w->tasks[w->tail].inode = inode;
+		w->tasks[w->tail].path = path;
+		++w->tail;
+	}
+	PTRAVERSE_UNLOCK(&w->lock);
+	if (err)
+		return err;
+
+	PTRAVERSE_LOCK(&pool->lock);
+	++pool->queued;
+	PTRAVERSE_WAKE(&pool->wake);
+	PTRAVERSE_UNLOCK(&pool->lock);
+	return SQFS_OK;
+}
+
+/* Take the newest of our own tasks, or else the oldest of someone else's */
+static bool sqfs_ptraverse_take(sqfs_ptraverse_worker *w,
+		sqfs_ptraverse_task *task) {
+	sqfs_ptraverse_pool *pool = w->pool;
+	size_t self = w - pool->workers, i;
+	bool found = false;
+
+	PTRAVERSE_LOCK(&w->lock);
+	if (w->tail > w->head) {
+		*task = w->tasks[--w->tail];
+		found = true;
+	}
+	PTRAVERSE_UNLOCK(&w->lock);
+
+	for (i = 1; !found && i < pool->nworkers; ++i) {
+		sqfs_ptraverse_worker *victim =
+			&pool->workers[(self + i) % pool->nworkers];
+		PTRAVERSE_LOCK(&victim->lock);
+		if (victim->tail > victim->head) {
+			*task = victim->tasks[victim->head++];
+			found = true;
+		}
+		PTRAVERSE_UNLOCK(&victim->lock);
+	}
+	return found;
+}
+
+static sqfs_err sqfs_ptraverse_path_reserve(sqfs_ptraverse_worker *w,
+		size_t size) {
+	if (size > w->path_cap) {
+		size_t cap = w->path_cap ? w->path_cap : SQUASHFS_NAME_LEN + 1;
+		char *path;
+		while (size > cap)
+			cap *= 2;
+		if (!(path = realloc(w->path, cap)))
+			return SQFS_ERR;
+		w->path = path;
+		w->path_cap = cap;
+	}
+	return SQFS_OK;
+}
+
+/* Visit each entry of a directory, queueing any subdirectories */
+static sqfs_err sqfs_ptraverse_dir(sqfs_ptraverse_worker *w,
+		sqfs_ptraverse_task *task) {
+	sqfs_ptraverse_pool *pool = w->pool;
+	sqfs_err err;
+	sqfs_inode inode;
+	sqfs_dir dir;
+	sqfs_dir_entry entry;
+	size_t base;
+
+	if ((err = sqfs_inode_get(w->fs, &inode, task->inode)))
+		return err;
+	if ((err = sqfs_dir_open(w->fs, &inode, &dir, 0)))
+		return err;
+
+	base = strlen(task->path);
+	if ((err = sqfs_ptraverse_path_reserve(w, base + 2)))
+		return err;
+	memcpy(w->path, task->path, base);
+	if (base > 0) /* The root has no name, so no separator */
+		w->path[base++] = PTRAVERSE_PATH_SEPARATOR;
+
+	sqfs_dentry_init(&entry, w->namebuf);
+	while (sqfs_dir_next(w->fs, &dir, &entry, &err)) {
+		size_t name_size = sqfs_dentry_name_size(&entry);
+		if ((err = sqfs_ptraverse_path_reserve(w, base + name_size + 1)))
+			return err;
+		memcpy(w->path + base, sqfs_dentry_name(&entry), name_size);
+		w->path[base + name_size] = '\0';
+
+		if ((err = pool->fn(w->fs, w->path, &entry, pool->data)))
+			return err;
+
+		if (sqfs_dentry_is_dir(&entry)) {
+			char *path = malloc(base + name_size + 1);
+			if (!path)
+				return SQFS_ERR;
+			memcpy(path, w->path, base + name_size + 1);
+			if ((err = sqfs_ptraverse_push(w, sqfs_dentry_inode(&entry), path))) {
+				free(path);
+				return err;
+			}
+		}
+	}
+	return err;
+}
+
+static void *sqfs_ptraverse_run(void *arg) {
+	sqfs_ptraverse_worker *w = arg;
+	sqfs_ptraverse_pool *pool = w->pool;
+	sqfs_ptraverse_task task;
+	sqfs_err err;
+	bool done;
+
+	while (true) {
+		if (sqfs_ptraverse_take(w, &task)) {
+			PTRAVERSE_LOCK(&pool->lock);
+			--pool->queued;
+			++pool->busy;
+			err = pool->err;
+			PTRAVERSE_UNLOCK(&pool->lock);
+
+			if (!err)
+				err = sqfs_ptraverse_dir(w, &task);
+			free(task.path);
+
+			PTRAVERSE_LOCK(&pool->lock);
+			if (err && !pool->err)
+				pool->err = err;
+			if (--pool->busy == 0 || pool->err)
+				PTRAVERSE_WAKE(&pool->wake);
+			PTRAVERSE_UNLOCK(&pool->lock);
+			continue;
+		}
+
+		/* Nothing to steal. Wait until someone queues more, or everyone is
+		   idle and we're finished. */
+		PTRAVERSE_LOCK(&pool->lock);
+		while (pool->queued <= 0 && pool->busy > 0 && !pool->err)
+			PTRAVERSE_WAIT(&pool->wake, &pool->lock);
+		done = pool->err || (pool->queued <= 0 && pool->busy == 0);
+		PTRAVERSE_UNLOCK(&pool->lock);
+		if (done)
+			return NULL;
+	}
+}
+
+sqfs_err sqfs_ptraverse(sqfs *fs, sqfs_inode_id iid, size_t threads,
+		sqfs_ptraverse_fn fn, void *data) {
+	sqfs_ptraverse_pool pool;
+	sqfs_err err;
+	char *root;
+	size_t i;
+
+#ifndef HAVE_PTHREAD
+	threads = 1;
+#endif
+	if (threads < 1)
+		threads = 1;
+
+	memset(&pool, 0, sizeof(pool));
+	pool.fn = fn;
+	pool.data = data;
+	if (!(pool.workers = calloc(threads, sizeof(*pool.workers))))
+		return SQFS_ERR;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.wake, NULL);
+#endif
+
+	/* If we can't get a handle for another thread, make do with fewer */
+	for (i = 0; i < threads; ++i) {
+		sqfs_ptraverse_worker *w = &pool.workers[i];
+		if (i == 0) {
+			w->fs = fs;
+		} else {
+			if (sqfs_init_clone(&w->clone, fs))
+				break;
+			w->fs = &w->clone;
+		}
+		w->pool = &pool;
+#ifdef HAVE_PTHREAD
+		pthread_mutex_init(&w->lock, NULL);
+#endif
+	}
+	pool.nworkers = i;
+
+	if (!(root = malloc(1))) {
+		err = SQFS_ERR;
+		goto done;
+	}
+	root[0] = '\0';
+	if ((err = sqfs_ptraverse_push(&pool.workers[0], iid, root))) {
+		free(root);
+		goto done;
+	}
+
+#ifdef HAVE_PTHREAD
+	for (i = 1; i < pool.nworkers; ++i) {
+		sqfs_ptraverse_worker *w = &pool.workers[i];
+		w->started = (pthread_create(&w->thread, NULL, sqfs_ptraverse_run,
+			w) == 0);
+	}
+#endif
+	sqfs_ptraverse_run(&pool.workers[0]);
+#ifdef HAVE_PTHREAD
+	for (i = 1; i < pool.nworkers; ++i) {
+		if (pool.workers[i].started)
+			pthread_join(pool.workers[i].thread, NULL);
+	}
+#endif
+	err = pool.err;
+
+done:
+	for (i = 0; i < pool.nworkers; ++i) {
+		sqfs_ptraverse_worker *w = &pool.workers[i];
+		for (; w->head < w->tail; ++w->head)
+			free(w->tasks[w->head].path);
+		free(w->tasks);
+		free(w->path);
+		if (w->fs == &w->clone)
+			sqfs_destroy(&w->clone);
+#ifdef HAVE_PTHREAD
+		pthread_mutex_destroy(&w->lock);
+#endif
+	}
+#ifdef HAVE_PTHREAD
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.wake);
+#endif
+	free(pool.workers);
+	return err;
+}
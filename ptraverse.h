@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SQFS_PTRAVERSE_H
+#define SQFS_PTRAVERSE_H
+
+#include "common.h"
+
+#include "dir.h"
+
+/* Parallel traversal of a filesystem tree, for tools that do work on every
+ * entry of a large image.
+ *
+ * Implementation
+ *	- Each thread has its own filesystem handle from sqfs_init_clone, since
+ *	  the caches aren't thread-safe
+ *	- Each thread has a deque of directories still to be read. It pushes the
+ *	  subdirectories it finds onto the back, and takes its next directory
+ *	  from the back too, so it stays depth-first and near recent metadata.
+ *	- An idle thread steals from the front of another thread's deque, which
+ *	  holds the oldest and usually largest subtrees
+ */
+
+/* Called for each entry, with its path relative to the root of the traversal
+ * and a filesystem handle that only this thread is using. Returning anything
+ * but SQFS_OK stops the traversal. */
+typedef sqfs_err (*sqfs_ptraverse_fn)(sqfs *fs, const char *path,
+	sqfs_dir_entry *entry, void *data);
+
+/* Call fn for every sub-item of the given inode, but not the inode itself,
+ * using up to 'threads' threads. The calling thread is one of them, and uses
+ * 'fs'. Entries are visited in no particular order, and fn may be called from
+ * several threads at once, but a directory is always visited before its
+ * contents. */
+sqfs_err sqfs_ptraverse(sqfs *fs, sqfs_inode_id iid, size_t threads,
+	sqfs_ptraverse_fn fn, void *data);
+
+#endif
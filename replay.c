@@ -0,0 +1,471 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ll.h"
+#include "fuseprivate.h"
+#include "nonstd.h"
+#include "stat.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PROGNAME "squashfuse_replay"
+
+#define ERR_MISC	(1)
+#define ERR_USAGE	(2)
+#define ERR_OPEN	(3)
+
+/* Like FUSE's own directory entries, for filling readdir buffers */
+#define REPLAY_DIRENT_SIZE(namelen) (((24 + (namelen)) + 7) & ~(size_t)7)
+
+static void usage() {
+	fprintf(stderr, "Usage: %s [-p] [-o OFFSET] ARCHIVE TRACE\n", PROGNAME);
+	fprintf(stderr, "Replay a trace recorded by squashfuse_ll -o trace_file, without FUSE,\n");
+	fprintf(stderr, "and print statistics about the work it took.\n");
+	fprintf(stderr, "  -p  preload metadata, like -o preload_metadata\n");
+	exit(ERR_USAGE);
+}
+
+static void die(const char *msg) {
+	fprintf(stderr, "%s\n", msg);
+	exit(ERR_MISC);
+}
+
+/* An open file or directory. The handlers keep the inode in the file handle,
+   so we keep it here. */
+typedef struct {
+	fuse_ino_t ino;
+	size_t refs;
+	sqfs_inode inode;
+	bool raw_checked;	/* Whether raw is known yet */
+	bool raw;			/* Stored verbatim, see sqfs_file_stored_raw */
+	uint64_t raw_start;
+	bool has_stream;	/* Like squashfuse_ll, see SQFS_LL_STREAMS */
+	sqfs_stream stream;
+} replay_handle;
+
+typedef struct {
+	sqfs_ll *ll;
+	replay_handle *handles;
+	size_t nhandles, handles_cap, streams;
+	char *buf;
+	size_t buf_size;
+
+	uint64_t count[SQFS_LL_OP_COUNT], errors[SQFS_LL_OP_COUNT];
+	uint64_t read_bytes;
+} replay;
+
+static char *replay_buf(replay *r, size_t size) {
+	if (size > r->buf_size) {
+		char *buf = realloc(r->buf, size);
+		if (!buf)
+			die("malloc error");
+		r->buf = buf;
+		r->buf_size = size;
+	}
+	return r->buf;
+}
+
+static replay_handle *replay_handle_find(replay *r, fuse_ino_t ino) {
+	size_t i;
+	for (i = r->nhandles; i > 0; --i) {
+		if (r->handles[i - 1].ino == ino)
+			return &r->handles[i - 1];
+	}
+	return NULL;
+}
+
+static sqfs_err replay_handle_open(replay *r, fuse_ino_t ino) {
+	replay_handle *h = replay_handle_find(r, ino);
+	if (h) {
+		++h->refs;
+		return SQFS_OK;
+	}
+	if (r->nhandles == r->handles_cap) {
+		size_t cap = r->handles_cap ? r->handles_cap * 2 : 16;
+		if (!(h = realloc(r->handles, cap * sizeof(*h))))
+			die("malloc error");
+		r->handles = h;
+		r->handles_cap = cap;
+	}
+	h = &r->handles[r->nhandles];
+	if (sqfs_ll_inode(r->ll, &h->inode, ino))
+		return SQFS_ERR;
+	h->ino = ino;
+	h->refs = 1;
+	h->raw_checked = false;
+	h->raw = false;
+	sqfs_stream_init(&h->stream);
+	h->has_stream = S_ISREG(h->inode.base.mode) && r->streams < SQFS_LL_STREAMS;
+	if (h->has_stream)
+		++r->streams;
+	++r->nhandles;
+	return SQFS_OK;
+}
+
+static void replay_handle_release(replay *r, fuse_ino_t ino) {
+	replay_handle *h = replay_handle_find(r, ino);
+	if (h && --h->refs == 0) {
+		if (h->has_stream) {
+			sqfs_stream_destroy(&h->stream);
+			--r->streams;
+		}
+		*h = r->handles[--r->nhandles];
+	}
+}
+
+/* An open file. If the trace started after it was opened, open it now. */
+static replay_handle *replay_handle_get(replay *r, fuse_ino_t ino) {
+	replay_handle *h = replay_handle_find(r, ino);
+	if (!h && replay_handle_open(r, ino) == SQFS_OK)
+		h = replay_handle_find(r, ino);
+	return h;
+}
+
+#if HAVE_DECL_FUSE_REPLY_DATA
+/* Like sqfs_ll_check_raw, on the first read */
+static void replay_check_raw(replay *r, replay_handle *h) {
+	h->raw = sqfs_file_stored_raw(&r->ll->fs, &h->inode, &h->raw_start);
+	h->raw_checked = true;
+	if (h->raw && h->has_stream) {
+		sqfs_stream_destroy(&h->stream);
+		h->has_stream = false;
+		--r->streams;
+	}
+}
+
+/* squashfuse_ll has FUSE copy these straight from the image, so just read
+   them, and count them the same way */
+static sqfs_err replay_read_raw(replay *r, replay_handle *h, uint64_t off,
+		size_t size) {
+	sqfs *fs = &r->ll->fs;
+	uint64_t file_size = h->inode.xtra.reg.file_size;
+
+	if (off >= file_size)
+		return SQFS_OK;
+	if (size > file_size - off)
+		size = (size_t)(file_size - off);
+	if (sqfs_pread_raw(fs->fd, replay_buf(r, size), size, h->raw_start + off)
+			!= (ssize_t)size)
+		return SQFS_ERR;
+	++fs->stats.raw_reads;
+	fs->stats.raw_bytes += size;
+	r->read_bytes += size;
+	return SQFS_OK;
+}
+#endif
+
+/* Do the same library work as the handler in ll.c */
+static sqfs_err replay_do(replay *r, sqfs_ll_op op, fuse_ino_t ino,
+		uint64_t a, uint64_t b, const char *name) {
+	sqfs_ll *ll = r->ll;
+	sqfs *fs = &ll->fs;
+	sqfs_inode inode;
+	replay_handle *h;
+	sqfs_dir_entry entry;
+	sqfs_name namebuf;
+	struct stat st;
+	size_t size;
+	int found;
+
+	switch (op) {
+		case SQFS_LL_OP_GETATTR:
+			if (sqfs_ll_inode(ll, &inode, ino))
+				return SQFS_ERR;
+			return sqfs_stat(fs, &inode, &st);
+
+		case SQFS_LL_OP_OPENDIR:
+		case SQFS_LL_OP_OPEN:
+			return replay_handle_open(r, ino);
+
+		case SQFS_LL_OP_RELEASEDIR:
+		case SQFS_LL_OP_RELEASE:
+			replay_handle_release(r, ino);
+			return SQFS_OK;
+
+		case SQFS_LL_OP_CREATE:
+			return SQFS_OK;
+
+		case SQFS_LL_OP_READDIR: {
+			sqfs_dir dir;
+			sqfs_err err;
+			if (!(h = replay_handle_get(r, ino)))
+				return SQFS_ERR;
+			if (sqfs_dir_open(fs, &h->inode, &dir, a))
+				return SQFS_ERR;
+			size = b;
+			sqfs_dentry_init(&entry, namebuf);
+			while (sqfs_dir_next(fs, &dir, &entry, &err)) {
+				size_t esize = REPLAY_DIRENT_SIZE(sqfs_dentry_name_size(&entry));
+				ll->ino_fuse_num(ll, &entry);
+				if (esize > size)
+					break;
+				size -= esize;
+			}
+			return err;
+		}
+
+		case SQFS_LL_OP_LOOKUP:
+			if (sqfs_ll_inode(ll, &inode, ino))
+				return SQFS_ERR;
+			sqfs_dentry_init(&entry, namebuf);
+			if (sqfs_dir_lookup(fs, &inode, name, strlen(name), &entry, &found))
+				return SQFS_ERR;
+			if (!(found & FOUND))
+				return SQFS_OK; /* A negative entry, not an error */
+			if (sqfs_inode_get(fs, &inode, sqfs_dentry_inode(&entry))
+					|| sqfs_stat(fs, &inode, &st))
+				return SQFS_ERR;
+			ll->ino_register(ll, &entry);
+			return SQFS_OK;
+
+		case SQFS_LL_OP_READ: {
+			sqfs_off_t osize = b;
+			sqfs_hole holes[SQFS_LL_HOLES];
+			size_t nholes = SQFS_LL_HOLES;
+			if (!(h = replay_handle_get(r, ino)))
+				return SQFS_ERR;
+#if HAVE_DECL_FUSE_REPLY_DATA
+			if (!h->raw_checked)
+				replay_check_raw(r, h);
+			if (h->raw)
+				return replay_read_raw(r, h, a, b);
+#endif
+			if (sqfs_read_range_holes(fs, &h->inode,
+					h->has_stream ? &h->stream : NULL, a, &osize,
+					replay_buf(r, b), holes, &nholes))
+				return SQFS_ERR;
+			r->read_bytes += osize;
+			return SQFS_OK;
+		}
+
+		case SQFS_LL_OP_READLINK:
+			if (sqfs_ll_inode(ll, &inode, ino)
+					|| sqfs_readlink(fs, &inode, NULL, &size))
+				return SQFS_ERR;
+			return sqfs_readlink(fs, &inode, replay_buf(r, size + 1), &size);
+
+		case SQFS_LL_OP_LISTXATTR:
+			if (sqfs_ll_inode(ll, &inode, ino))
+				return SQFS_ERR;
+			size = a;
+			return sqfs_listxattr(fs, &inode, a ? replay_buf(r, a) : NULL, &size)
+				? SQFS_ERR : SQFS_OK;
+
+		case SQFS_LL_OP_GETXATTR:
+			if (sqfs_ll_inode(ll, &inode, ino))
+				return SQFS_ERR;
+			size = a;
+			return sqfs_xattr_lookup(fs, &inode, name, replay_buf(r, a + 1),
+				&size);
+
+		case SQFS_LL_OP_FORGET:
+			ll->ino_forget(ll, ino, a);
+			return SQFS_OK;
+
+		case SQFS_LL_OP_STATFS: {
+			struct statvfs stv;
+			return sqfs_statfs(fs, &stv) ? SQFS_ERR : SQFS_OK;
+		}
+
+		case SQFS_LL_OP_LSEEK: {
+			sqfs_off_t pos;
+			if (!(h = replay_handle_get(r, ino)))
+				return SQFS_ERR;
+			return sqfs_file_seek(fs, &h->inode, a, b == 1, &pos);
+		}
+
+		default:
+			return SQFS_ERR;
+	}
+}
+
+/* Undo the escaping of backslash and newline, in place */
+static void replay_unescape(char *s) {
+	char *out = s;
+	for (; *s; ++s) {
+		if (*s == '\\' && s[1]) {
+			++s;
+			*out++ = (*s == 'n') ? '\n' : *s;
+		} else {
+			*out++ = *s;
+		}
+	}
+	*out = '\0';
+}
+
+static void replay_trace(replay *r, FILE *f) {
+	char *line = NULL;
+	size_t cap = 0, lineno = 0;
+
+	while (true) {
+		char opname[32];
+		unsigned long long usec, ino, a, b;
+		size_t len = 0;
+		int c, off = 0;
+		sqfs_ll_op op;
+		char *name = NULL;
+
+		/* Read a line, however long */
+		while ((c = getc(f)) != EOF && c != '\n') {
+			if (len + 1 >= cap) {
+				cap = cap ? cap * 2 : 256;
+				if (!(line = realloc(line, cap)))
+					die("malloc error");
+			}
+			line[len++] = c;
+		}
+		if (c == EOF && len == 0)
+			break;
+		++lineno;
+		if (line)
+			line[len] = '\0';
+		if (lineno == 1 && (!line || strcmp(line, SQFS_LL_TRACE_HEADER) != 0))
+			die("Not a squashfuse trace, or from another version");
+		if (!line || line[0] == '#')
+			continue;
+
+		if (sscanf(line, "%llu %31s %llu %llu %llu%n", &usec, opname, &ino, &a,
+				&b, &off) != 5) {
+			fprintf(stderr, "%s: bad trace line %lu\n", PROGNAME,
+				(unsigned long)lineno);
+			exit(ERR_MISC);
+		}
+		for (op = 0; op < SQFS_LL_OP_COUNT; ++op) {
+			if (strcmp(opname, sqfs_ll_op_names[op]) == 0)
+				break;
+		}
+		if (op == SQFS_LL_OP_COUNT) {
+			fprintf(stderr, "%s: unknown operation '%s' on line %lu\n", PROGNAME,
+				opname, (unsigned long)lineno);
+			exit(ERR_MISC);
+		}
+		if (line[off] == ' ') {
+			name = line + off + 1;
+			replay_unescape(name);
+		} else if (op == SQFS_LL_OP_LOOKUP || op == SQFS_LL_OP_GETXATTR) {
+			fprintf(stderr, "%s: missing name on line %lu\n", PROGNAME,
+				(unsigned long)lineno);
+			exit(ERR_MISC);
+		}
+
+		++r->count[op];
+		if (replay_do(r, op, (fuse_ino_t)ino, a, b, name))
+			++r->errors[op];
+	}
+	free(line);
+}
+
+static double replay_usec(struct timespec *start, struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) * 1e6
+		+ (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static void replay_hit_rate(const char *name, sqfs_cache *cache) {
+	uint64_t total = cache->hits + cache->misses;
+	if (total)
+		printf("replay.hit_pct.%s %.1f\n", name, 100.0 * cache->hits / total);
+}
+
+int main(int argc, char *argv[]) {
+	replay r;
+	FILE *f;
+	size_t offset = 0;
+	bool preload = false;
+	struct timespec wall_start, wall_end, cpu_start, cpu_end;
+	sqfs_stats_buf b;
+	char stats[16 * 1024];
+	uint64_t ops = 0, errors = 0;
+	size_t i;
+
+	while (argc > 1 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-p") == 0) {
+			preload = true;
+			argv += 1;
+			argc -= 1;
+		} else if (strcmp(argv[1], "-o") == 0 && argc > 2) {
+			offset = strtoul(argv[2], NULL, 10);
+			argv += 2;
+			argc -= 2;
+		} else {
+			usage();
+		}
+	}
+	if (argc != 3)
+		usage();
+
+	memset(&r, 0, sizeof(r));
+	if (!(r.ll = sqfs_ll_open(argv[1], offset)))
+		exit(ERR_OPEN);
+	if (preload && sqfs_md_arena_load(&r.ll->fs))
+		fprintf(stderr, "Can't preload metadata, continuing without it.\n");
+	if (!(f = fopen(argv[2], "r"))) {
+		perror(argv[2]);
+		exit(ERR_OPEN);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &wall_start);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+	replay_trace(&r, f);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+	clock_gettime(CLOCK_MONOTONIC, &wall_end);
+	fclose(f);
+
+	for (i = 0; i < SQFS_LL_OP_COUNT; ++i) {
+		ops += r.count[i];
+		errors += r.errors[i];
+	}
+	printf("replay.ops %llu\n", (unsigned long long)ops);
+	printf("replay.errors %llu\n", (unsigned long long)errors);
+	printf("replay.read_bytes %llu\n", (unsigned long long)r.read_bytes);
+	printf("replay.cpu_usec %.0f\n", replay_usec(&cpu_start, &cpu_end));
+	printf("replay.wall_usec %.0f\n", replay_usec(&wall_start, &wall_end));
+	for (i = 0; i < SQFS_LL_OP_COUNT; ++i) {
+		if (r.count[i])
+			printf("op.%s.count %llu\n", sqfs_ll_op_names[i],
+				(unsigned long long)r.count[i]);
+		if (r.errors[i])
+			printf("op.%s.errors %llu\n", sqfs_ll_op_names[i],
+				(unsigned long long)r.errors[i]);
+	}
+	replay_hit_rate("metadata", &r.ll->fs.md_cache);
+	replay_hit_rate("data", &r.ll->fs.data_cache);
+	replay_hit_rate("fragment", &r.ll->fs.frag_cache);
+	replay_hit_rate("blockidx", &r.ll->fs.blockidx);
+
+	sqfs_stats_buf_init(&b, stats, sizeof(stats));
+	sqfs_stats_format(&r.ll->fs, &b);
+	fwrite(b.buf, 1, b.len, stdout);
+
+	for (i = 0; i < r.nhandles; ++i)
+		sqfs_stream_destroy(&r.handles[i].stream);
+	free(r.handles);
+	free(r.buf);
+	sqfs_ll_destroy(r.ll);
+	free(r.ll);
+	return 0;
+}
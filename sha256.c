@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "sha256.h"
+
+#include <string.h>
+
+static const uint32_t sqfs_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sqfs_sha256_block(sqfs_sha256 *ctx, const unsigned char *p) {
+	uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	for (i = 0; i < 16; ++i, p += 4)
+		w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16
+			| (uint32_t)p[2] << 8 | p[3];
+	for (; i < 64; ++i) {
+		uint32_t s0 = ROTR(w[i-15], 7) ^ ROTR(w[i-15], 18) ^ (w[i-15] >> 3);
+		uint32_t s1 = ROTR(w[i-2], 17) ^ ROTR(w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+
+	a = ctx->state[0]; b = ctx->state[1]; c = ctx->state[2]; d = ctx->state[3];
+	e = ctx->state[4]; f = ctx->state[5]; g = ctx->state[6]; h = ctx->state[7];
+	for (i = 0; i < 64; ++i) {
+		t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g))
+			+ sqfs_sha256_k[i] + w[i];
+		t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22))
+			+ ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c;
+	ctx->state[3] += d; ctx->state[4] += e; ctx->state[5] += f;
+	ctx->state[6] += g; ctx->state[7] += h;
+}
+
+void sqfs_sha256_init(sqfs_sha256 *ctx) {
+	static const uint32_t init[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	memcpy(ctx->state, init, sizeof(init));
+	ctx->count = 0;
+}
+
+void sqfs_sha256_update(sqfs_sha256 *ctx, const void *data, size_t size) {
+	const unsigned char *p = data;
+	size_t used = ctx->count % sizeof(ctx->buf);
+
+	ctx->count += size;
+	if (used) {
+		size_t take = sizeof(ctx->buf) - used;
+		if (take > size)
+			take = size;
+		memcpy(ctx->buf + used, p, take);
+		p += take;
+		size -= take;
+		if (used + take < sizeof(ctx->buf))
+			return;
+		sqfs_sha256_block(ctx, ctx->buf);
+	}
+	for (; size >= sizeof(ctx->buf); p += sizeof(ctx->buf),
+			size -= sizeof(ctx->buf))
+		sqfs_sha256_block(ctx, p);
+	memcpy(ctx->buf, p, size);
+}
+
+void sqfs_sha256_final(sqfs_sha256 *ctx, unsigned char *digest) {
+	uint64_t bits = ctx->count * 8;
+	size_t used = ctx->count % sizeof(ctx->buf);
+	int i;
+
+	ctx->buf[used++] = 0x80;
+	if (used > sizeof(ctx->buf) - 8) {
+		memset(ctx->buf + used, 0, sizeof(ctx->buf) - used);
+		sqfs_sha256_block(ctx, ctx->buf);
+		used = 0;
+	}
+	memset(ctx->buf + used, 0, sizeof(ctx->buf) - 8 - used);
+	for (i = 0; i < 8; ++i)
+		ctx->buf[sizeof(ctx->buf) - 1 - i] = (unsigned char)(bits >> (8 * i));
+	sqfs_sha256_block(ctx, ctx->buf);
+
+	for (i = 0; i < 8; ++i) {
+		digest[4*i] = (unsigned char)(ctx->state[i] >> 24);
+		digest[4*i + 1] = (unsigned char)(ctx->state[i] >> 16);
+		digest[4*i + 2] = (unsigned char)(ctx->state[i] >> 8);
+		digest[4*i + 3] = (unsigned char)ctx->state[i];
+	}
+}
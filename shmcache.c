@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "shmcache.h"
+
+#include "fs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_SHM_CACHE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* How often to check whether another process has finished creating the
+ * segment, before giving up */
+#define SHM_CACHE_WAIT_TRIES 100
+#define SHM_CACHE_WAIT_NSEC 10000000
+
+/* A slot is in use by a writer while its sequence number is odd. A slot with
+ * size zero is empty, so a freshly created segment needs no initialization.
+ * If a writer dies mid-write, the next writer to find the slot takes it
+ * over, since the segment outlives us. The sequence number and the writer's
+ * pid share one word, so they always change together. */
+typedef struct {
+	uint64_t lock;		/* seq << 32 | pid of the writer, while seq is odd */
+	uint32_t size;
+	uint32_t pad;
+	uint64_t pos;
+	uint64_t sum;		/* sqfs_content_hash of the block's on-disk bytes */
+} sqfs_shm_slot;
+
+#define SHM_LOCK(seq, owner) ((uint64_t)(seq) << 32 | (uint32_t)(owner))
+#define SHM_LOCK_SEQ(lock) ((uint32_t)((lock) >> 32))
+#define SHM_LOCK_OWNER(lock) ((pid_t)(uint32_t)(lock))
+
+typedef struct {
+	void *map;
+	size_t map_size;
+	size_t nslots;
+	size_t slot_size;
+	sqfs_shm_slot *slots;
+	char *data;
+} sqfs_shm_cache;
+
+static size_t sqfs_shm_cache_index(sqfs_shm_cache *sc, sqfs_off_t pos) {
+	uint64_t h = (uint64_t)pos * 0x9e3779b97f4a7c15ULL;
+	return (size_t)((h >> 32) % sc->nslots);
+}
+
+/* Wait for whoever created the segment to size it, and check that it's safe
+ * to use. A size of zero means it was never sized. */
+static sqfs_err sqfs_shm_cache_attach(int fd, size_t *size) {
+	struct timespec wait = { 0, SHM_CACHE_WAIT_NSEC };
+	struct stat st;
+	int i;
+
+	*size = 0;
+	for (i = 0; i < SHM_CACHE_WAIT_TRIES; ++i) {
+		if (fstat(fd, &st) == -1)
+			return SQFS_ERR;
+		/* Anyone else who can write it could feed us bad blocks */
+		if (st.st_uid != geteuid() || (st.st_mode & 077))
+			return SQFS_ERR;
+		if (st.st_size > 0) {
+			*size = st.st_size;
+			return SQFS_OK;
+		}
+		nanosleep(&wait, NULL);
+	}
+	return SQFS_OK;
+}
+
+/* Open the segment, creating it if needed. Returns its size, or zero on
+ * failure. */
+static size_t sqfs_shm_cache_open(const char *name, size_t want, int *fdp) {
+	size_t size;
+	int fd, tries;
+
+	for (tries = 0; tries < 2; ++tries) {
+		if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) != -1) {
+			if (ftruncate(fd, want) == -1) {
+				close(fd);
+				shm_unlink(name);
+				return 0;
+			}
+			*fdp = fd;
+			return want;
+		}
+		if (errno != EEXIST || (fd = shm_open(name, O_RDWR, 0)) == -1)
+			return 0;
+		if (sqfs_shm_cache_attach(fd, &size)) {
+			close(fd);
+			return 0;
+		}
+		if (size) {
+			*fdp = fd;
+			return size;
+		}
+		close(fd);
+
+		/* Its creator must have died before sizing it, start over */
+		shm_unlink(name);
+	}
+	return 0;
+}
+
+sqfs_err sqfs_shm_cache_init(sqfs *fs, uint64_t size) {
+	sqfs_shm_cache *sc;
+	char name[64];
+	uint64_t id;
+	size_t map_size, table_size;
+	int fd;
+
+	if (fs->crypto) /* Don't leave decrypted data lying around */
+		return SQFS_UNSUP;
+	if (sqfs_image_id(fs, &id))
+		return SQFS_ERR;
+
+	snprintf(name, sizeof(name), "/squashfuse-%lu-%016llx",
+		(unsigned long)geteuid(), (unsigned long long)id);
+	if (!(map_size = sqfs_shm_cache_open(name, size, &fd)))
+		return SQFS_ERR;
+
+	if (!(sc = malloc(sizeof(*sc)))) {
+		close(fd);
+		return SQFS_ERR;
+	}
+	sc->map_size = map_size;
+	sc->slot_size = fs->sb.block_size;
+	sc->nslots = map_size / (sizeof(sqfs_shm_slot) + sc->slot_size);
+	sc->map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (sc->nslots == 0 || sc->map == MAP_FAILED) {
+		if (sc->map != MAP_FAILED)
+			munmap(sc->map, map_size);
+		free(sc);
+		return SQFS_ERR;
+	}
+
+	table_size = sc->nslots * sizeof(sqfs_shm_slot);
+	sc->slots = sc->map;
+	sc->data = (char*)sc->map + table_size;
+
+	fs->shm_cache = sc;
+	return SQFS_OK;
+}
+
+void sqfs_shm_cache_destroy(sqfs *fs) {
+	sqfs_shm_cache *sc = fs->shm_cache;
+	if (!sc)
+		return;
+	munmap(sc->map, sc->map_size);
+	free(sc);
+	fs->shm_cache = NULL;
+}
+
+sqfs_err sqfs_shm_cache_get(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+		sqfs_block **block) {
+	sqfs_shm_cache *sc = fs->shm_cache;
+	sqfs_shm_slot *slot;
+	uint64_t lock;
+	uint32_t size;
+	size_t idx;
+	sqfs_block *b;
+
+	if (!sc)
+		return SQFS_ERR;
+
+	idx = sqfs_shm_cache_index(sc, pos);
+	slot = &sc->slots[idx];
+	lock = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+	if (SHM_LOCK_SEQ(lock) & 1)
+		return SQFS_ERR; /* Being written */
+	size = __atomic_load_n(&slot->size, __ATOMIC_RELAXED);
+	if (size == 0 || size > sc->slot_size
+			|| __atomic_load_n(&slot->pos, __ATOMIC_RELAXED) != (uint64_t)pos
+			|| __atomic_load_n(&slot->sum, __ATOMIC_RELAXED) != sum)
+		return SQFS_ERR;
+
+	if (!(b = malloc(sizeof(*b))))
+		return SQFS_ERR;
+	if (!(b->data = malloc(size))) {
+		free(b);
+		return SQFS_ERR;
+	}
+	b->size = size;
+	memcpy(b->data, sc->data + idx * sc->slot_size, size);
+
+	/* If a writer got in while we were copying, our copy may be torn */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&slot->lock, __ATOMIC_RELAXED) != lock) {
+		sqfs_block_dispose(b);
+		return SQFS_ERR;
+	}
+
+	*block = b;
+	return SQFS_OK;
+}
+
+/* Is this writer gone? */
+static bool sqfs_shm_owner_gone(pid_t owner) {
+	return owner > 0 && owner != getpid() && kill(owner, 0) == -1
+		&& errno == ESRCH;
+}
+
+void sqfs_shm_cache_put(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+		sqfs_block *block) {
+	sqfs_shm_cache *sc = fs->shm_cache;
+	sqfs_shm_slot *slot;
+	uint64_t lock, mine;
+	uint32_t seq, next;
+	size_t idx;
+
+	if (!sc || block->size == 0 || block->size > sc->slot_size)
+		return;
+
+	idx = sqfs_shm_cache_index(sc, pos);
+	slot = &sc->slots[idx];
+	lock = __atomic_load_n(&slot->lock, __ATOMIC_RELAXED);
+	seq = SHM_LOCK_SEQ(lock);
+	if (seq & 1) {
+		if (!sqfs_shm_owner_gone(SHM_LOCK_OWNER(lock)))
+			return;
+		next = seq + 2; /* Stays odd, readers keep missing */
+	} else {
+		if (__atomic_load_n(&slot->pos, __ATOMIC_RELAXED) == (uint64_t)pos
+				&& __atomic_load_n(&slot->sum, __ATOMIC_RELAXED) == sum
+				&& __atomic_load_n(&slot->size, __ATOMIC_RELAXED)
+					== block->size)
+			return; /* Another process already stored it */
+		next = seq + 1;
+	}
+	mine = SHM_LOCK(next, getpid());
+	if (!__atomic_compare_exchange_n(&slot->lock, &lock, mine, false,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return; /* Lost the race to another writer, just drop this block */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	__atomic_store_n(&slot->pos, (uint64_t)pos, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->sum, sum, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->size, (uint32_t)block->size, __ATOMIC_RELAXED);
+	memcpy(sc->data + idx * sc->slot_size, block->data, block->size);
+
+	/* Only finish if nobody took the slot over, thinking we were dead */
+	__atomic_compare_exchange_n(&slot->lock, &mine, SHM_LOCK(next + 1, 0),
+		false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+#else /* HAVE_SHM_CACHE */
+
+sqfs_err sqfs_shm_cache_init(sqfs *fs, uint64_t size) {
+	return SQFS_UNSUP;
+}
+
+void sqfs_shm_cache_destroy(sqfs *fs) { }
+
+sqfs_err sqfs_shm_cache_get(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+		sqfs_block **block) {
+	return SQFS_ERR;
+}
+
+void sqfs_shm_cache_put(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+	sqfs_block *block) { }
+
+#endif /* HAVE_SHM_CACHE */
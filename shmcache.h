@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SQFS_SHMCACHE_H
+#define SQFS_SHMCACHE_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+/* Cache of decompressed data blocks in a POSIX shared memory segment, so that
+ * several processes mounting the same image share one copy of each block.
+ *
+ * Implementation
+ *	- One segment per image and user, named by the user id and sqfs_image_id,
+ *	  and left in place when the last process exits so later mounts start
+ *	  warm. A segment that another user owns or can write is never used.
+ *	- The segment is a direct-mapped table of block-sized slots, indexed by
+ *	  a hash of the block's position. Each slot also records a hash of the
+ *	  block's on-disk bytes, which lookups must match.
+ *	- Each slot is guarded by a sequence counter. Readers never block: a
+ *	  lookup that races with a writer just misses.
+ *	- A slot whose writer died mid-write is taken over by the next writer,
+ *	  found by checking the pid recorded in the slot
+ */
+
+/* Attach to the shared cache for this image, creating it with room for about
+ * 'size' bytes of blocks if it doesn't exist yet */
+sqfs_err sqfs_shm_cache_init(sqfs *fs, uint64_t size);
+void sqfs_shm_cache_destroy(sqfs *fs);
+
+/* Get a copy of a decompressed data block, whose on-disk bytes have the
+ * sqfs_content_hash 'sum'. Fails if the cache is disabled, or doesn't have the
+ * block. */
+sqfs_err sqfs_shm_cache_get(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+	sqfs_block **block);
+
+/* Store a decompressed data block. Best effort, may be dropped. */
+void sqfs_shm_cache_put(sqfs *fs, sqfs_off_t pos, uint64_t sum,
+	sqfs_block *block);
+
+#endif
@@ -28,6 +28,7 @@
 #include "dir.h"
 #include "file.h"
 #include "fs.h"
+#include "ptraverse.h"
 #include "traverse.h"
 #include "util.h"
 #include "xattr.h"
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "stats.h"
+
+#include "fs.h"
+
+#include <string.h>
+
+void sqfs_stats_buf_init(sqfs_stats_buf *b, char *buf, size_t size) {
+	b->buf = buf;
+	b->size = size;
+	b->len = 0;
+}
+
+void sqfs_stats_str(sqfs_stats_buf *b, const char *str) {
+	size_t len = strlen(str);
+	if (len > b->size - b->len)
+		len = b->size - b->len;
+	memcpy(b->buf + b->len, str, len);
+	b->len += len;
+}
+
+/* No printf, it's not safe in a signal handler */
+void sqfs_stats_uint(sqfs_stats_buf *b, uint64_t value) {
+	char digits[21];
+	size_t i = sizeof(digits);
+	digits[--i] = '\0';
+	do {
+		digits[--i] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	sqfs_stats_str(b, digits + i);
+}
+
+void sqfs_stats_put(sqfs_stats_buf *b, const char *prefix, const char *name,
+		uint64_t value) {
+	sqfs_stats_str(b, prefix);
+	sqfs_stats_str(b, name);
+	sqfs_stats_str(b, " ");
+	sqfs_stats_uint(b, value);
+	sqfs_stats_str(b, "\n");
+}
+
+static void sqfs_stats_cache(sqfs_stats_buf *b, const char *prefix,
+		sqfs_cache *cache) {
+	sqfs_stats_put(b, prefix, ".hits", cache->hits);
+	sqfs_stats_put(b, prefix, ".misses", cache->misses);
+	sqfs_stats_put(b, prefix, ".evictions", cache->evictions);
+}
+
+void sqfs_stats_format(sqfs *fs, sqfs_stats_buf *b) {
+	sqfs_stats *st = &fs->stats;
+	const char *comp = sqfs_compression_name(fs->sb.compression);
+	if (!comp)
+		comp = "unknown";
+	
+	sqfs_stats_put(b, "pread", ".calls", st->pread_calls);
+	sqfs_stats_put(b, "pread", ".bytes", st->pread_bytes);
+	
+	sqfs_stats_str(b, "decompress.");
+	sqfs_stats_put(b, comp, ".blocks", st->decompress_blocks);
+	sqfs_stats_str(b, "decompress.");
+	sqfs_stats_put(b, comp, ".bytes_in", st->decompress_in);
+	sqfs_stats_str(b, "decompress.");
+	sqfs_stats_put(b, comp, ".bytes_out", st->decompress_out);
+	sqfs_stats_put(b, "stored", ".blocks", st->stored_blocks);
+	
+	sqfs_stats_cache(b, "cache.metadata", &fs->md_cache);
+	sqfs_stats_cache(b, "cache.data", &fs->data_cache);
+	sqfs_stats_cache(b, "cache.fragment", &fs->frag_cache);
+	sqfs_stats_cache(b, "cache.blockidx", &fs->blockidx);
+	sqfs_stats_put(b, "cache.shared", ".hits", st->shared_hits);
+	sqfs_stats_put(b, "cache.shared", ".misses", st->shared_misses);
+	sqfs_stats_put(b, "cache.stream", ".hits", st->stream_hits);
+	sqfs_stats_put(b, "raw", ".reads", st->raw_reads);
+	sqfs_stats_put(b, "raw", ".bytes", st->raw_bytes);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SQFS_STATS_H
+#define SQFS_STATS_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+/* Counters of the work a filesystem handle has done, to help size caches and
+ * spot regressions. Like the caches, each handle has its own, so they need no
+ * locking. Hits, misses and evictions of each cache are kept in the
+ * sqfs_cache itself.
+ *
+ * Everything here is async-signal-safe, so a signal handler can dump them. */
+typedef struct {
+	uint64_t pread_calls, pread_bytes;
+	
+	/* Blocks passed to the decompressor, and bytes in and out */
+	uint64_t decompress_blocks, decompress_in, decompress_out;
+	/* Blocks that were stored uncompressed */
+	uint64_t stored_blocks;
+	
+	/* Data blocks found in, or missing from, the disk or shm caches */
+	uint64_t shared_hits, shared_misses;
+	/* Data blocks found in a reader's sqfs_stream */
+	uint64_t stream_hits;
+	
+	/* Reads of files stored verbatim, handed straight to FUSE from the
+	 * image (see sqfs_file_stored_raw) */
+	uint64_t raw_reads, raw_bytes;
+} sqfs_stats;
+
+/* Text output, one "name value" line per counter */
+typedef struct {
+	char *buf;
+	size_t size, len;		/* Output past 'size' is dropped */
+} sqfs_stats_buf;
+
+void sqfs_stats_buf_init(sqfs_stats_buf *b, char *buf, size_t size);
+void sqfs_stats_str(sqfs_stats_buf *b, const char *str);
+void sqfs_stats_uint(sqfs_stats_buf *b, uint64_t value);
+/* Append a line "<prefix><name> <value>" */
+void sqfs_stats_put(sqfs_stats_buf *b, const char *prefix, const char *name,
+	uint64_t value);
+
+/* Append all the counters of a filesystem */
+void sqfs_stats_format(sqfs *fs, sqfs_stats_buf *b);
+
+#endif
@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "squashfuse.h"
+#include "squashfs_fs.h"
+#include "sha256.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+
+#define PROGNAME "squashfuse_sum"
+
+#define ERR_MISC	(1)
+#define ERR_USAGE	(2)
+#define ERR_OPEN	(3)
+
+/* Read files this many blocks at a time */
+#define SUM_READ_BLOCKS 8
+
+static void usage() {
+	fprintf(stderr, "Usage: %s [-j THREADS] ARCHIVE\n", PROGNAME);
+	fprintf(stderr, "       %s [-j THREADS] -c MANIFEST ARCHIVE\n", PROGNAME);
+	fprintf(stderr, "Print the SHA-256 of each regular file, like sha256sum.\n");
+	fprintf(stderr, "  -c  check the files against a manifest made by %s or sha256sum\n",
+		PROGNAME);
+	exit(ERR_USAGE);
+}
+
+static void die(const char *msg) {
+	fprintf(stderr, "%s\n", msg);
+	exit(ERR_MISC);
+}
+
+typedef struct {
+	char *path;
+	sqfs_inode_id inode;
+	uint64_t order;		/* Where its data is in the image */
+	unsigned char digest[SQFS_SHA256_SIZE];
+} sum_file;
+
+static struct {
+	sum_file *files;
+	size_t count, cap;
+	size_t next;		/* Next file to hash */
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t lock;
+#endif
+} files = {
+#ifdef HAVE_PTHREAD
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
+
+static void files_lock() {
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&files.lock);
+#endif
+}
+
+static void files_unlock() {
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&files.lock);
+#endif
+}
+
+/* Called from several threads at once by sqfs_ptraverse */
+static sqfs_err sum_collect(sqfs *fs, const char *path, sqfs_dir_entry *entry,
+		void *unused_data) {
+	struct squashfs_fragment_entry frag;
+	sqfs_inode inode;
+	sqfs_err err;
+	sum_file *f;
+	char *copy;
+	uint64_t order;
+
+	(void)unused_data;
+	if (!S_ISREG(sqfs_dentry_mode(entry)))
+		return SQFS_OK;
+	if ((err = sqfs_inode_get(fs, &inode, sqfs_dentry_inode(entry))))
+		return err;
+
+	/* A small file lives entirely in a fragment, so sort it with the
+	   fragment's other files */
+	order = inode.xtra.reg.start_block;
+	if (inode.xtra.reg.file_size < fs->sb.block_size
+			&& inode.xtra.reg.frag_idx != SQUASHFS_INVALID_FRAG) {
+		if ((err = sqfs_frag_entry(fs, &frag, inode.xtra.reg.frag_idx)))
+			return err;
+		order = frag.start_block;
+	}
+
+	if (!(copy = malloc(strlen(path) + 1)))
+		return SQFS_ERR;
+	strcpy(copy, path);
+
+	files_lock();
+	if (files.count == files.cap) {
+		size_t cap = files.cap ? files.cap * 2 : 1024;
+		sum_file *nfiles = realloc(files.files, cap * sizeof(*nfiles));
+		if (!nfiles) {
+			files_unlock();
+			free(copy);
+			return SQFS_ERR;
+		}
+		files.files = nfiles;
+		files.cap = cap;
+	}
+	f = &files.files[files.count++];
+	f->path = copy;
+	f->inode = sqfs_dentry_inode(entry);
+	f->order = order;
+	files_unlock();
+	return SQFS_OK;
+}
+
+static int sum_file_order_cmp(const void *a, const void *b) {
+	const sum_file *fa = a, *fb = b;
+	if (fa->order != fb->order)
+		return fa->order < fb->order ? -1 : 1;
+	return 0;
+}
+
+static int sum_file_path_cmp(const void *a, const void *b) {
+	const sum_file *fa = a, *fb = b;
+	return strcmp(fa->path, fb->path);
+}
+
+/* Each thread has its own filesystem, since the caches aren't thread-safe */
+typedef struct {
+	sqfs *fs;
+	sqfs clone;
+	char *buf;
+	size_t buf_size;
+#ifdef HAVE_PTHREAD
+	pthread_t thread;
+	bool started;
+#endif
+} sum_worker;
+
+static void sum_file_hash(sum_worker *w, sum_file *f) {
+	sqfs_inode inode;
+	sqfs_sha256 ctx;
+	sqfs_off_t pos = 0, file_size;
+
+	if (sqfs_inode_get(w->fs, &inode, f->inode))
+		die("sqfs_inode_get error");
+	file_size = inode.xtra.reg.file_size;
+
+	sqfs_sha256_init(&ctx);
+	while (pos < file_size) {
+		sqfs_off_t size = w->buf_size;
+		if (sqfs_read_range(w->fs, &inode, pos, &size, w->buf) || size == 0)
+			die("sqfs_read_range error");
+		sqfs_sha256_update(&ctx, w->buf, size);
+		pos += size;
+	}
+	sqfs_sha256_final(&ctx, f->digest);
+}
+
+/* Hash files in disk order. Each thread takes the next file, so the image is
+   read roughly sequentially even with many threads. */
+static void *sum_thread(void *arg) {
+	sum_worker *w = arg;
+	while (true) {
+		sum_file *f = NULL;
+		files_lock();
+		if (files.next < files.count)
+			f = &files.files[files.next++];
+		files_unlock();
+		if (!f)
+			return NULL;
+		sum_file_hash(w, f);
+	}
+}
+
+static void sum_all(sqfs *fs, size_t threads) {
+	sum_worker *workers;
+	size_t i;
+
+	if (threads < 1)
+		threads = 1;
+	if (!(workers = calloc(threads, sizeof(*workers))))
+		die("malloc error");
+	for (i = 0; i < threads; ++i) {
+		sum_worker *w = &workers[i];
+		if (i == 0) {
+			w->fs = fs;
+		} else {
+			if (sqfs_init_clone(&w->clone, fs))
+				die("Can't open the image again for another thread");
+			w->fs = &w->clone;
+		}
+		w->buf_size = (size_t)fs->sb.block_size * SUM_READ_BLOCKS;
+		if (!(w->buf = malloc(w->buf_size)))
+			die("malloc error");
+	}
+
+	qsort(files.files, files.count, sizeof(*files.files), sum_file_order_cmp);
+	files.next = 0;
+#ifdef HAVE_PTHREAD
+	for (i = 1; i < threads; ++i) {
+		if (pthread_create(&workers[i].thread, NULL, sum_thread, &workers[i]))
+			die("pthread_create error");
+		workers[i].started = true;
+	}
+#endif
+	sum_thread(&workers[0]);
+
+	for (i = 0; i < threads; ++i) {
+#ifdef HAVE_PTHREAD
+		if (workers[i].started)
+			pthread_join(workers[i].thread, NULL);
+#endif
+		if (i > 0)
+			sqfs_destroy(&workers[i].clone);
+		free(workers[i].buf);
+	}
+	free(workers);
+	qsort(files.files, files.count, sizeof(*files.files), sum_file_path_cmp);
+}
+
+/* sha256sum marks lines whose path has a backslash or newline with a leading
+   backslash, and escapes those characters */
+static bool sum_needs_escape(const char *path) {
+	return strpbrk(path, "\\\n\r") != NULL;
+}
+
+static void sum_print_path(const char *path) {
+	for (; *path; ++path) {
+		switch (*path) {
+			case '\\': fputs("\\\\", stdout); break;
+			case '\n': fputs("\\n", stdout); break;
+			case '\r': fputs("\\r", stdout); break;
+			default: putchar(*path);
+		}
+	}
+}
+
+static void sum_print(sum_file *f) {
+	static const char hex[] = "0123456789abcdef";
+	char digest[SQFS_SHA256_SIZE * 2];
+	bool escape = sum_needs_escape(f->path);
+	size_t i;
+
+	for (i = 0; i < SQFS_SHA256_SIZE; ++i) {
+		digest[2*i] = hex[f->digest[i] >> 4];
+		digest[2*i + 1] = hex[f->digest[i] & 0xf];
+	}
+	if (escape)
+		putchar('\\');
+	fwrite(digest, 1, sizeof(digest), stdout);
+	fputs("  ", stdout);
+	if (escape)
+		sum_print_path(f->path);
+	else
+		fputs(f->path, stdout);
+	putchar('\n');
+}
+
+
+/* A line of a manifest, pointing into the manifest's text */
+typedef struct {
+	char *path;
+	unsigned char digest[SQFS_SHA256_SIZE];
+} sum_entry;
+
+static int sum_entry_cmp(const void *a, const void *b) {
+	const sum_entry *ea = a, *eb = b;
+	return strcmp(ea->path, eb->path);
+}
+
+static int sum_hex(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+/* Parse one nul-terminated line in place. Returns false if it's malformed. */
+static bool sum_parse_line(char *line, sum_entry *e) {
+	bool escaped = (*line == '\\');
+	char *in, *out;
+	size_t i;
+
+	if (escaped)
+		++line;
+	for (i = 0; i < SQFS_SHA256_SIZE; ++i) {
+		int hi = sum_hex(line[2*i]), lo = hi < 0 ? -1 : sum_hex(line[2*i + 1]);
+		if (lo < 0)
+			return false;
+		e->digest[i] = (unsigned char)(hi << 4 | lo);
+	}
+	line += SQFS_SHA256_SIZE * 2;
+	if (line[0] != ' ' || (line[1] != ' ' && line[1] != '*') || !line[2])
+		return false;
+	e->path = line + 2;
+
+	if (escaped) {
+		for (in = out = e->path; *in; ++in, ++out) {
+			if (*in == '\\') {
+				++in;
+				if (*in == 'n')
+					*in = '\n';
+				else if (*in == 'r')
+					*in = '\r';
+				else if (*in != '\\')
+					return false;
+			}
+			*out = *in;
+		}
+		*out = '\0';
+	}
+
+	/* From sha256sum run on the output of find */
+	if (e->path[0] == '.' && e->path[1] == '/')
+		e->path += 2;
+	return true;
+}
+
+static char *sum_read_manifest(const char *name, sum_entry **entries,
+		size_t *count) {
+	FILE *fp;
+	char *text = NULL, *line, *end;
+	size_t size = 0, cap = 0, n, cap_entries = 0;
+
+	if (!(fp = fopen(name, "rb"))) {
+		perror(name);
+		exit(ERR_OPEN);
+	}
+	do {
+		if (size == cap) {
+			cap = cap ? cap * 2 : 64 * 1024;
+			if (!(text = realloc(text, cap + 1)))
+				die("malloc error");
+		}
+		n = fread(text + size, 1, cap - size, fp);
+		size += n;
+	} while (n > 0);
+	if (ferror(fp))
+		die("Can't read manifest");
+	fclose(fp);
+	text[size] = '\0';
+
+	*entries = NULL;
+	*count = 0;
+	for (line = text; line < text + size; line = end + 1) {
+		if (!(end = strchr(line, '\n')))
+			end = text + size;
+		*end = '\0';
+		if (end > line && end[-1] == '\r')
+			end[-1] = '\0';
+		if (!*line)
+			continue;
+
+		if (*count == cap_entries) {
+			cap_entries = cap_entries ? cap_entries * 2 : 1024;
+			if (!(*entries = realloc(*entries, cap_entries * sizeof(**entries))))
+				die("malloc error");
+		}
+		if (!sum_parse_line(line, &(*entries)[*count])) {
+			fprintf(stderr, "%s: bad line: %s\n", name, line);
+			exit(ERR_MISC);
+		}
+		++*count;
+	}
+	qsort(*entries, *count, sizeof(**entries), sum_entry_cmp);
+	return text;
+}
+
+/* Compare the files with a manifest. Everything must match: a file missing
+   from either side is a failure too. Returns the number of failures. */
+static size_t sum_check(const char *manifest) {
+	sum_entry *entries;
+	size_t count, i = 0, j = 0, failed = 0;
+	char *text = sum_read_manifest(manifest, &entries, &count);
+
+	while (i < files.count || j < count) {
+		int cmp;
+		if (i == files.count)
+			cmp = 1;
+		else if (j == count)
+			cmp = -1;
+		else
+			cmp = strcmp(files.files[i].path, entries[j].path);
+
+		if (cmp < 0) {
+			printf("%s: not in manifest\n", files.files[i++].path);
+			++failed;
+		} else if (cmp > 0) {
+			printf("%s: FAILED open or read\n", entries[j++].path);
+			++failed;
+		} else {
+			if (memcmp(files.files[i].digest, entries[j].digest,
+					SQFS_SHA256_SIZE) != 0) {
+				printf("%s: FAILED\n", entries[j].path);
+				++failed;
+			}
+			++i;
+			++j;
+		}
+	}
+	if (failed)
+		fprintf(stderr, "%s: WARNING: %lu of %lu files did NOT match\n",
+			PROGNAME, (unsigned long)failed, (unsigned long)count);
+
+	free(entries);
+	free(text);
+	return failed;
+}
+
+int main(int argc, char *argv[]) {
+	sqfs fs;
+	sqfs_err err;
+	long threads = 1;
+	const char *manifest = NULL;
+	size_t i, failed = 0;
+
+#ifdef _SC_NPROCESSORS_ONLN
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	while (argc > 1 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-j") == 0 && argc > 2) {
+			threads = atol(argv[2]);
+			if (threads < 1)
+				usage();
+			argv += 2;
+			argc -= 2;
+		} else if (strcmp(argv[1], "-c") == 0 && argc > 2) {
+			manifest = argv[2];
+			argv += 2;
+			argc -= 2;
+		} else {
+			usage();
+		}
+	}
+#ifndef HAVE_PTHREAD
+	threads = 1;
+#endif
+	if (threads < 1)
+		threads = 1;
+	if (argc != 2)
+		usage();
+
+	if ((err = sqfs_open_image(&fs, argv[1], 0)))
+		exit(ERR_OPEN);
+
+	if (sqfs_ptraverse(&fs, sqfs_inode_root(&fs), threads, sum_collect, NULL))
+		die("sqfs_ptraverse error");
+	sum_all(&fs, threads);
+
+	setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+	if (manifest) {
+		failed = sum_check(manifest);
+	} else {
+		for (i = 0; i < files.count; ++i)
+			sum_print(&files.files[i]);
+	}
+	if (fflush(stdout))
+		die("write error");
+
+	for (i = 0; i < files.count; ++i)
+		free(files.files[i].path);
+	free(files.files);
+	sqfs_destroy(&fs);
+	sqfs_fd_close(fs.fd);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/* Microbenchmarks of the core library.
+ *
+ * Usage: squashfuse_bench IMAGE [LABEL]
+ *
+ * Each result is printed as one tab-separated line:
+ *	LABEL	BENCHMARK	VALUE	UNIT
+ * so runs can be collected and compared by scripts. tests/bench.sh builds
+ * synthetic images for each compressor and runs this on them.
+ *
+ * Everything runs in one thread, reading through the OS page cache. Reads use
+ * a fresh filesystem handle, so the library's own caches start cold.
+ */
+#include "squashfuse.h"
+#include "aes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* Repeat each benchmark for at least this long */
+#define BENCH_MIN_NSEC 200000000ULL
+
+#define BENCH_READ_CHUNK (128 * 1024)
+#define BENCH_RANDOM_READ 4096
+#define BENCH_AES_BUF (1024 * 1024)
+
+/* Directory sizes are grouped by powers of ten, for lookup latency */
+#define BENCH_DIR_DECADES 8
+
+typedef struct {
+	sqfs_inode_id *inodes;		/* Every inode in the image */
+	size_t ninodes, inodes_cap;
+
+	sqfs_inode_id dirs[BENCH_DIR_DECADES]; /* Largest directory of each size */
+	size_t dir_entries[BENCH_DIR_DECADES];
+
+	sqfs_inode_id file;			/* Largest regular file */
+	sqfs_off_t file_size;
+} bench_image;
+
+static const char *label;
+static uint64_t rand_state = 0x9e3779b97f4a7c15ULL;
+
+static void usage() {
+	fprintf(stderr, "Usage: squashfuse_bench IMAGE [LABEL]\n");
+	exit(-2);
+}
+
+static void die(const char *msg) {
+	fprintf(stderr, "%s\n", msg);
+	exit(1);
+}
+
+static uint64_t bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* xorshift64, so every run does the same work */
+static uint64_t bench_rand(void) {
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return rand_state;
+}
+
+static void bench_report(const char *name, double value, const char *unit) {
+	printf("%s\t%s\t%.1f\t%s\n", label, name, value, unit);
+	fflush(stdout);
+}
+
+static void bench_clone(sqfs *fs, sqfs *orig) {
+	if (sqfs_init_clone(fs, orig))
+		die("Can't open another filesystem handle");
+}
+
+static void bench_inode(sqfs *fs, sqfs_inode *inode, sqfs_inode_id id) {
+	if (sqfs_inode_get(fs, inode, id))
+		die("sqfs_inode_get error");
+}
+
+static void bench_add_inode(bench_image *img, sqfs_inode_id id) {
+	if (img->ninodes == img->inodes_cap) {
+		img->inodes_cap = img->inodes_cap ? img->inodes_cap * 2 : 1024;
+		if (!(img->inodes = realloc(img->inodes,
+				img->inodes_cap * sizeof(*img->inodes))))
+			die("Out of memory");
+	}
+	img->inodes[img->ninodes++] = id;
+}
+
+static size_t bench_dir_count(sqfs *fs, sqfs_inode_id id) {
+	sqfs_inode inode;
+	sqfs_dir dir;
+	sqfs_dir_entry entry;
+	sqfs_name name;
+	sqfs_err err;
+	size_t count = 0;
+
+	bench_inode(fs, &inode, id);
+	if (sqfs_dir_open(fs, &inode, &dir, 0))
+		die("sqfs_dir_open error");
+	sqfs_dentry_init(&entry, name);
+	while (sqfs_dir_next(fs, &dir, &entry, &err))
+		++count;
+	if (err)
+		die("sqfs_dir_next error");
+	return count;
+}
+
+static void bench_add_dir(sqfs *fs, bench_image *img, sqfs_inode_id id) {
+	size_t count = bench_dir_count(fs, id), decade = 0, n;
+	for (n = count; n >= 10 && decade < BENCH_DIR_DECADES - 1; n /= 10)
+		++decade;
+	if (count > img->dir_entries[decade]) {
+		img->dirs[decade] = id;
+		img->dir_entries[decade] = count;
+	}
+}
+
+/* Find what to work on */
+static void bench_scan(sqfs *fs, bench_image *img) {
+	sqfs_traverse trv;
+	sqfs_inode inode;
+	sqfs_err err;
+
+	memset(img, 0, sizeof(*img));
+	bench_add_inode(img, sqfs_inode_root(fs));
+	bench_add_dir(fs, img, sqfs_inode_root(fs));
+
+	if (sqfs_traverse_open(&trv, fs, sqfs_inode_root(fs)))
+		die("sqfs_traverse_open error");
+	while (sqfs_traverse_next(&trv, &err)) {
+		sqfs_inode_id id;
+		if (trv.dir_end)
+			continue;
+		id = sqfs_dentry_inode(&trv.entry);
+		bench_add_inode(img, id);
+		if (sqfs_dentry_is_dir(&trv.entry)) {
+			bench_add_dir(fs, img, id);
+		} else if (S_ISREG(sqfs_dentry_mode(&trv.entry))) {
+			bench_inode(fs, &inode, id);
+			if (inode.xtra.reg.file_size > img->file_size) {
+				img->file = id;
+				img->file_size = inode.xtra.reg.file_size;
+			}
+		}
+	}
+	if (err)
+		die("sqfs_traverse_next error");
+	sqfs_traverse_close(&trv);
+}
+
+static void bench_traverse(sqfs *fs) {
+	sqfs_traverse trv;
+	sqfs_err err;
+	uint64_t start = bench_now(), elapsed, entries = 0;
+
+	do {
+		if (sqfs_traverse_open(&trv, fs, sqfs_inode_root(fs)))
+			die("sqfs_traverse_open error");
+		while (sqfs_traverse_next(&trv, &err))
+			++entries;
+		if (err)
+			die("sqfs_traverse_next error");
+		sqfs_traverse_close(&trv);
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_NSEC);
+	bench_report("traverse", entries * 1e9 / elapsed, "entries/s");
+}
+
+static void bench_inode_get(sqfs *fs, bench_image *img) {
+	sqfs_inode inode;
+	uint64_t start = bench_now(), elapsed, count = 0;
+	size_t i;
+
+	do {
+		for (i = 0; i < img->ninodes; ++i)
+			bench_inode(fs, &inode, img->inodes[img->ninodes - 1 - i]);
+		count += img->ninodes;
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_NSEC);
+	bench_report("inode_get", count * 1e9 / elapsed, "inodes/s");
+}
+
+/* Look up every name in a directory, in random order */
+static void bench_lookup(sqfs *fs, sqfs_inode_id id, size_t entries) {
+	sqfs_inode inode;
+	sqfs_dir dir;
+	sqfs_dir_entry entry;
+	sqfs_name name;
+	sqfs_err err;
+	char **names, metric[32];
+	size_t i, count = 0;
+	uint64_t start, elapsed, lookups = 0;
+	int found;
+
+	if (!(names = malloc(entries * sizeof(*names))))
+		die("Out of memory");
+	bench_inode(fs, &inode, id);
+	if (sqfs_dir_open(fs, &inode, &dir, 0))
+		die("sqfs_dir_open error");
+	sqfs_dentry_init(&entry, name);
+	while (count < entries && sqfs_dir_next(fs, &dir, &entry, &err)) {
+		size_t size = sqfs_dentry_name_size(&entry) + 1;
+		if (!(names[count] = malloc(size)))
+			die("Out of memory");
+		memcpy(names[count++], sqfs_dentry_name(&entry), size);
+	}
+	for (i = count; i > 1; --i) {
+		size_t j = bench_rand() % i;
+		char *t = names[i - 1];
+		names[i - 1] = names[j];
+		names[j] = t;
+	}
+
+	start = bench_now();
+	do {
+		for (i = 0; i < count; ++i) {
+			if (sqfs_dir_lookup(fs, &inode, names[i], strlen(names[i]), &entry,
+					&found) || !found)
+				die("sqfs_dir_lookup error");
+		}
+		lookups += count;
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_NSEC);
+
+	snprintf(metric, sizeof(metric), "lookup_%lu", (unsigned long)count);
+	bench_report(metric, (double)elapsed / lookups, "ns");
+	for (i = 0; i < count; ++i)
+		free(names[i]);
+	free(names);
+}
+
+static void bench_read_seq(sqfs *orig, bench_image *img) {
+	sqfs fs;
+	sqfs_inode inode;
+	char *buf;
+	uint64_t start = bench_now(), elapsed, bytes = 0;
+
+	if (!(buf = malloc(BENCH_READ_CHUNK)))
+		die("Out of memory");
+	do {
+		sqfs_off_t pos, size;
+		bench_clone(&fs, orig);
+		bench_inode(&fs, &inode, img->file);
+		for (pos = 0; pos < img->file_size; pos += size) {
+			size = BENCH_READ_CHUNK;
+			if (sqfs_read_range(&fs, &inode, pos, &size, buf) || size == 0)
+				die("sqfs_read_range error");
+		}
+		bytes += img->file_size;
+		sqfs_destroy(&fs);
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_NSEC);
+	bench_report("read_seq", bytes * 1e9 / elapsed / (1024 * 1024), "MiB/s");
+	free(buf);
+}
+
+static void bench_read_random(sqfs *orig, bench_image *img) {
+	sqfs fs;
+	sqfs_inode inode;
+	char buf[BENCH_RANDOM_READ];
+	uint64_t start, elapsed, reads = 0;
+
+	bench_clone(&fs, orig);
+	bench_inode(&fs, &inode, img->file);
+	start = bench_now();
+	do {
+		sqfs_off_t pos = bench_rand() % img->file_size, size = sizeof(buf);
+		if (sqfs_read_range(&fs, &inode, pos, &size, buf))
+			die("sqfs_read_range error");
+		++reads;
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_NSEC);
+	bench_report("read_random", reads * 1e9 / elapsed, "reads/s");
+	sqfs_destroy(&fs);
+}
+
+static void bench_cache_report(const char *name, sqfs_cache *cache) {
+	char metric[32];
+	uint64_t total = cache->hits + cache->misses;
+	if (total == 0)
+		return;
+	snprintf(metric, sizeof(metric), "mixed_hit_%s", name);
+	bench_report(metric, 100.0 * cache->hits / total, "%");
+}
+
+/* Random reads of the largest file and random inode lookups, four out of
+ * five going to a hot tenth of each */
+static void bench_mixed(sqfs *orig, bench_image *img) {
+	sqfs fs;
+	sqfs_inode file, inode;
+	char buf[BENCH_RANDOM_READ];
+	uint64_t start, elapsed, ops = 0;
+
+	bench_clone(&fs, orig);
+	bench_inode(&fs, &file, img->file);
+	start = bench_now();
+	do {
+		uint64_t r = bench_rand();
+		bool hot = (r >> 8) % 5 != 0;
+		if (r & 1) {
+			sqfs_off_t range = hot ? img->file_size / 10 + 1 : img->file_size;
+			sqfs_off_t pos = (r >> 16) % range, size = sizeof(buf);
+			if (sqfs_read_range(&fs, &file, pos, &size, buf))
+				die("sqfs_read_range error");
+		} else {
+			size_t range = hot ? img->ninodes / 10 + 1 : img->ninodes;
+			bench_inode(&fs, &inode, img->inodes[(r >> 16) % range]);
+		}
+		++ops;
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_NSEC);
+
+	bench_report("mixed", ops * 1e9 / elapsed, "ops/s");
+	bench_cache_report("metadata", &fs.md_cache);
+	bench_cache_report("data", &fs.data_cache);
+	bench_cache_report("fragment", &fs.frag_cache);
+	bench_cache_report("blockidx", &fs.blockidx);
+	sqfs_destroy(&fs);
+}
+
+/* Doesn't need an image, but encrypted images decrypt every read with it */
+static void bench_aes_ctr(void) {
+	struct AES_ctx ctx;
+	uint8_t key[AES_KEYLEN], iv[AES_BLOCKLEN];
+	uint8_t *buf;
+	uint64_t start = bench_now(), elapsed, bytes = 0;
+
+	memset(key, 0x5a, sizeof(key));
+	memset(iv, 0, sizeof(iv));
+	if (!(buf = calloc(1, BENCH_AES_BUF)))
+		die("Out of memory");
+	AES_init_ctx_iv(&ctx, key, iv);
+	do {
+		AES_CTR_xcrypt_buffer(&ctx, buf, BENCH_AES_BUF, 0);
+		bytes += BENCH_AES_BUF;
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_NSEC);
+	bench_report("aes_ctr", bytes * 1e9 / elapsed / (1024 * 1024), "MiB/s");
+	free(buf);
+}
+
+int main(int argc, char *argv[]) {
+	sqfs fs;
+	bench_image img;
+	size_t i;
+
+	if (argc < 2 || argc > 3)
+		usage();
+	label = argc > 2 ? argv[2] : argv[1];
+	if (sqfs_open_image(&fs, argv[1], 0))
+		exit(1);
+
+	bench_scan(&fs, &img);
+	bench_traverse(&fs);
+	bench_inode_get(&fs, &img);
+	for (i = 0; i < BENCH_DIR_DECADES; ++i) {
+		if (img.dir_entries[i])
+			bench_lookup(&fs, img.dirs[i], img.dir_entries[i]);
+	}
+	if (img.file_size > 0) {
+		bench_read_seq(&fs, &img);
+		bench_read_random(&fs, &img);
+		bench_mixed(&fs, &img);
+	}
+	bench_aes_ctr();
+
+	free(img.inodes);
+	sqfs_destroy(&fs);
+	return 0;
+}
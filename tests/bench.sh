@@ -0,0 +1,42 @@
+#!/bin/sh
+
+. "tests/lib.sh"
+
+# Build a synthetic image with each compressor, and run squashfuse_bench on
+# it. Results go to stdout as tab-separated lines, everything else to stderr:
+#
+#   make bench > bench.tsv
+
+BENCH=${1:-./squashfuse_bench}
+FILE_LINES=${BENCH_FILE_LINES:-4000000}   # About 30 MiB of text
+
+trap cleanup EXIT
+set -e
+
+WORKDIR=$(mktemp -d)
+
+cleanup() {
+    set +e # Don't care about errors here.
+    if [ -n "$WORKDIR" ]; then
+        rm -rf "$WORKDIR"
+    fi
+}
+
+find_compressors >&2
+
+# A large compressible file, and directories of small files from ten to ten
+# thousand entries, so lookups and fragments get exercised.
+mkdir -p "$WORKDIR/source"
+seq 1 "$FILE_LINES" > "$WORKDIR/source/large"
+for n in 10 100 1000 10000; do
+    mkdir "$WORKDIR/source/dir$n"
+    seq 1 $((n * 10)) | split -l 10 -a 5 - "$WORKDIR/source/dir$n/file"
+done
+
+for comp in $compressors; do
+    echo "Building $comp squashfs image..." >&2
+    mksquashfs "$WORKDIR/source" "$WORKDIR/squashfs.image" -comp $comp \
+        -no-progress >/dev/null
+    "$BENCH" "$WORKDIR/squashfs.image" $comp
+    rm -f "$WORKDIR/squashfs.image"
+done
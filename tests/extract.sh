@@ -0,0 +1,117 @@
+#!/bin/sh
+
+. "tests/lib.sh"
+
+# Extract an image with squashfuse_extract, and check that every file comes
+# back with the same contents and metadata as the tree it was built from.
+
+EXTRACT="$(pwd)/squashfuse_extract"
+
+trap cleanup EXIT
+set -e
+
+WORKDIR=$(mktemp -d)
+
+cleanup() {
+    set +e # Don't care about errors here.
+    if [ -n "$WORKDIR" ]; then
+        rm -rf "$WORKDIR"
+    fi
+}
+
+# Type, mode, link count, mtime and, for regular files, size of everything
+# in the current directory
+if stat -c '' . >/dev/null 2>&1; then
+    STAT="stat -c %n:%f:%h:%Y"      # GNU
+else
+    STAT="stat -f %N:%p:%l:%m"      # BSD
+fi
+listing() {
+    find . | sort | while read -r f; do
+        if [ -f "$f" ] && [ ! -L "$f" ]; then
+            size=$(wc -c < "$f" | tr -d ' ')
+        else
+            size=-
+        fi
+        echo "$($STAT "$f"):$size"
+    done
+}
+
+find_compressors
+
+echo "Generating test files..."
+mkdir -p "$WORKDIR/source/dir/sub/deeper" "$WORKDIR/source/private"
+head -c 3000000 /dev/urandom >"$WORKDIR/source/rand"
+yes squashfuse | head -c 2000000 >"$WORKDIR/source/dir/text"
+head -c 100 /dev/urandom >"$WORKDIR/source/dir/sub/small"
+: >"$WORKDIR/source/dir/sub/deeper/empty"
+dd if=/dev/urandom of="$WORKDIR/source/sparse" bs=4096 count=1 2>/dev/null
+dd if=/dev/urandom of="$WORKDIR/source/sparse" bs=4096 count=1 seek=1024 \
+    conv=notrunc 2>/dev/null
+dd if=/dev/zero of="$WORKDIR/source/sparse" bs=1 count=0 seek=6000000 \
+    2>/dev/null
+ln "$WORKDIR/source/dir/text" "$WORKDIR/source/hardlink"
+ln -s dir/sub/small "$WORKDIR/source/symlink"
+mkfifo "$WORKDIR/source/dir/fifo"
+chmod 0640 "$WORKDIR/source/dir/sub/small"
+chmod 0755 "$WORKDIR/source/rand"
+chmod 0700 "$WORKDIR/source/private"
+touch -t 201001020304 "$WORKDIR/source/dir/sub"
+
+xattrs=
+if command -v setfattr >/dev/null && command -v getfattr >/dev/null \
+        && setfattr -n user.squashfuse -v test "$WORKDIR/source/rand" \
+            2>/dev/null; then
+    xattrs=yes
+    setfattr -n user.other -v 0x00ff "$WORKDIR/source/dir/text"
+else
+    echo "No user xattrs here, not testing them."
+fi
+
+(cd "$WORKDIR/source" && listing) > "$WORKDIR/source.list"
+
+for comp in $compressors; do
+    echo "Building $comp squashfs image..."
+    mksquashfs "$WORKDIR/source" "$WORKDIR/squashfs.image" -comp $comp \
+        -no-progress >/dev/null
+
+    for opts in "" "-d" "-j 1"; do
+        echo "Extracting with options '$opts'..."
+        rm -rf "$WORKDIR/out"
+        mkdir "$WORKDIR/out"
+        (cd "$WORKDIR/out" && "$EXTRACT" $opts "$WORKDIR/squashfs.image" -a \
+            >/dev/null 2>&1)
+        out="$WORKDIR/out/squashfs-root"
+
+        for f in rand dir/text dir/sub/small dir/sub/deeper/empty sparse \
+                hardlink; do
+            cmp "$WORKDIR/source/$f" "$out/$f"
+        done
+        if [ "$(readlink "$out/symlink")" != dir/sub/small ]; then
+            echo "Wrong symlink target!"
+            exit 1
+        fi
+
+        (cd "$out" && listing) > "$WORKDIR/out.list"
+        if ! diff -u "$WORKDIR/source.list" "$WORKDIR/out.list"; then
+            echo "Found differing metadata with options '$opts'!"
+            exit 1
+        fi
+
+        if [ -n "$xattrs" ]; then
+            for f in rand dir/text; do
+                a=$(cd "$WORKDIR/source" && getfattr -d -m user. "$f")
+                b=$(cd "$out" && getfattr -d -m user. "$f")
+                if [ "$a" != "$b" ]; then
+                    echo "Found differing xattrs on $f!"
+                    exit 1
+                fi
+            done
+        fi
+    done
+
+    rm -f "$WORKDIR/squashfs.image"
+done
+
+echo "Success."
+exit 0
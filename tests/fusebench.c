@@ -0,0 +1,572 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/* Workloads for benchmarking a mounted filesystem, run by tests/fuse-bench.sh.
+ *
+ * Usage: squashfuse_fusebench -s DIR > LIST
+ *        squashfuse_fusebench [-j THREADS] [-n LABEL] WORKLOAD DIR LIST
+ *
+ * The first form lists everything under DIR. The second runs a workload on
+ * a mount of the same tree, using the list so it doesn't have to walk the
+ * mount first and warm its caches. Mount afresh for each workload.
+ *
+ * Results are tab-separated lines, like squashfuse_bench:
+ *	LABEL	BENCHMARK	VALUE	UNIT
+ * with the throughput, then the median and 99th percentile latency of each
+ * operation.
+ */
+#include "config.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define PROGNAME "squashfuse_fusebench"
+
+#define FB_READ_CHUNK (128 * 1024)
+#define FB_RANDOM_READ 4096
+#define FB_RANDOM_READS 20000		/* Shared among all threads */
+#define FB_LARGE_FILE (1024 * 1024)
+#define FB_SMALL_FILE (64 * 1024)
+#define FB_LOOKUP_DEPTH 3			/* Paths at least this deep */
+
+typedef struct {
+	char type;					/* 'f', 'd' or 'o' for other */
+	uint64_t size;
+	int depth;
+	char *path;
+} fb_entry;
+
+typedef struct fb_thread fb_thread;
+typedef void (*fb_workload_fn)(fb_thread *t);
+
+/* Latencies of one thread's operations, in nanoseconds */
+struct fb_thread {
+	size_t id;
+	uint64_t *lat;
+	size_t nlat, lat_cap;
+	uint64_t bytes;
+	uint64_t rand;
+	char *buf;
+#ifdef HAVE_PTHREAD
+	pthread_t thread;
+#endif
+};
+
+typedef struct {
+	const char *name;
+	fb_workload_fn fn;
+	const char *unit;			/* Of throughput: per op, or bytes */
+} fb_workload;
+
+static struct {
+	const char *dir;
+	fb_entry *entries;
+	size_t count, cap;
+
+	/* Indexes of the entries this workload uses */
+	size_t *work;
+	size_t nwork;
+	size_t next;				/* Next to take */
+	size_t reads;				/* Random reads per thread */
+
+	fb_workload_fn fn;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t lock;
+#endif
+} fb = {
+#ifdef HAVE_PTHREAD
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
+
+static void usage() {
+	fprintf(stderr, "Usage: %s -s DIR > LIST\n", PROGNAME);
+	fprintf(stderr, "       %s [-j THREADS] [-n LABEL] WORKLOAD DIR LIST\n",
+		PROGNAME);
+	fprintf(stderr, "Workloads: seq_read random_read stat find small_read lookup\n");
+	exit(2);
+}
+
+static void die(const char *msg) {
+	perror(msg);
+	exit(1);
+}
+
+static void *fb_alloc(size_t size) {
+	void *p = malloc(size);
+	if (!p)
+		die("malloc");
+	return p;
+}
+
+static uint64_t fb_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t fb_rand(uint64_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+static void fb_lat(fb_thread *t, uint64_t start) {
+	if (t->nlat == t->lat_cap) {
+		t->lat_cap = t->lat_cap ? t->lat_cap * 2 : 1024;
+		if (!(t->lat = realloc(t->lat, t->lat_cap * sizeof(*t->lat))))
+			die("malloc");
+	}
+	t->lat[t->nlat++] = fb_now() - start;
+}
+
+static char *fb_path(const char *rel) {
+	size_t dlen = strlen(fb.dir), rlen = strlen(rel);
+	char *p = fb_alloc(dlen + rlen + 2);
+	memcpy(p, fb.dir, dlen);
+	p[dlen] = '/';
+	memcpy(p + dlen + 1, rel, rlen + 1);
+	return p;
+}
+
+/* Take the next entry to work on, or NULL */
+static fb_entry *fb_take(void) {
+	fb_entry *e = NULL;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&fb.lock);
+#endif
+	if (fb.next < fb.nwork)
+		e = &fb.entries[fb.work[fb.next++]];
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&fb.lock);
+#endif
+	return e;
+}
+
+
+/*** Listing ***/
+
+static void fb_scan(const char *dir, const char *rel, int depth) {
+	DIR *d;
+	struct dirent *de;
+
+	if (!(d = opendir(dir)))
+		die(dir);
+	while ((de = readdir(d))) {
+		struct stat st;
+		char *sub, *subrel;
+		char type;
+		size_t rlen = strlen(rel), nlen = strlen(de->d_name);
+
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		subrel = fb_alloc(rlen + nlen + 2);
+		memcpy(subrel, rel, rlen);
+		if (rlen)
+			subrel[rlen++] = '/';
+		memcpy(subrel + rlen, de->d_name, nlen + 1);
+		sub = fb_path(subrel);
+
+		if (lstat(sub, &st) == -1)
+			die(sub);
+		type = S_ISREG(st.st_mode) ? 'f' : S_ISDIR(st.st_mode) ? 'd' : 'o';
+		printf("%c %llu %d %s", type, (unsigned long long)st.st_size, depth,
+			subrel);
+		putchar('\0');
+		if (type == 'd')
+			fb_scan(sub, subrel, depth + 1);
+		free(sub);
+		free(subrel);
+	}
+	closedir(d);
+}
+
+static void fb_read_list(const char *name) {
+	FILE *f;
+	char *line = NULL;
+	size_t len = 0, cap = 0;
+	int c;
+
+	if (!(f = fopen(name, "r")))
+		die(name);
+	while ((c = getc(f)) != EOF) {
+		fb_entry *e;
+		unsigned long long size;
+		int depth, off;
+		char type;
+
+		if (len + 1 >= cap) {
+			cap = cap ? cap * 2 : 256;
+			if (!(line = realloc(line, cap)))
+				die("malloc");
+		}
+		line[len++] = c;
+		if (c != '\0')
+			continue;
+		len = 0;
+
+		if (sscanf(line, "%c %llu %d %n", &type, &size, &depth, &off) != 3) {
+			fprintf(stderr, "%s: bad list\n", name);
+			exit(1);
+		}
+		if (fb.count == fb.cap) {
+			fb.cap = fb.cap ? fb.cap * 2 : 1024;
+			if (!(fb.entries = realloc(fb.entries, fb.cap * sizeof(*fb.entries))))
+				die("malloc");
+		}
+		e = &fb.entries[fb.count++];
+		e->type = type;
+		e->size = size;
+		e->depth = depth;
+		e->path = fb_path(line + off);
+	}
+	fclose(f);
+	free(line);
+}
+
+/* Choose the entries to work on, in a random order */
+static void fb_select(bool (*want)(fb_entry *e)) {
+	uint64_t state = 0x9e3779b97f4a7c15ULL;
+	size_t i;
+
+	fb.work = fb_alloc((fb.count + 1) * sizeof(*fb.work));
+	fb.nwork = 0;
+	for (i = 0; i < fb.count; ++i) {
+		if (want(&fb.entries[i]))
+			fb.work[fb.nwork++] = i;
+	}
+	for (i = fb.nwork; i > 1; --i) {
+		size_t j = fb_rand(&state) % i, t = fb.work[i - 1];
+		fb.work[i - 1] = fb.work[j];
+		fb.work[j] = t;
+	}
+}
+
+static bool fb_want_large(fb_entry *e) {
+	return e->type == 'f' && e->size >= FB_LARGE_FILE;
+}
+
+static bool fb_want_small(fb_entry *e) {
+	return e->type == 'f' && e->size > 0 && e->size <= FB_SMALL_FILE;
+}
+
+static bool fb_want_any(fb_entry *e) {
+	return true;
+}
+
+static bool fb_want_deep(fb_entry *e) {
+	return e->depth >= FB_LOOKUP_DEPTH;
+}
+
+
+/*** Workloads ***/
+
+/* Read each file from start to end, timing each read */
+static void fb_read_file(fb_thread *t, fb_entry *e) {
+	ssize_t got;
+	int fd;
+
+	if ((fd = open(e->path, O_RDONLY)) == -1)
+		die(e->path);
+	do {
+		uint64_t start = fb_now();
+		if ((got = read(fd, t->buf, FB_READ_CHUNK)) == -1)
+			die(e->path);
+		fb_lat(t, start);
+		t->bytes += got;
+	} while (got > 0);
+	close(fd);
+}
+
+static void fb_seq_read(fb_thread *t) {
+	fb_entry *e;
+	while ((e = fb_take()))
+		fb_read_file(t, e);
+}
+
+/* Open, read and close whole files, timing each file */
+static void fb_small_read(fb_thread *t) {
+	fb_entry *e;
+	while ((e = fb_take())) {
+		uint64_t start = fb_now();
+		ssize_t got;
+		int fd;
+		if ((fd = open(e->path, O_RDONLY)) == -1)
+			die(e->path);
+		while ((got = read(fd, t->buf, FB_READ_CHUNK)) > 0)
+			t->bytes += got;
+		if (got == -1)
+			die(e->path);
+		close(fd);
+		fb_lat(t, start);
+	}
+}
+
+/* Random reads spread over all the large files. Each thread has its own
+ * descriptors, so it can seek them without pread. */
+static void fb_random_read(fb_thread *t) {
+	size_t i;
+	int *fds;
+
+	if (fb.nwork == 0)
+		return;
+	fds = fb_alloc(fb.nwork * sizeof(*fds));
+	for (i = 0; i < fb.nwork; ++i) {
+		if ((fds[i] = open(fb.entries[fb.work[i]].path, O_RDONLY)) == -1)
+			die(fb.entries[fb.work[i]].path);
+	}
+	for (i = 0; i < fb.reads; ++i) {
+		uint64_t r = fb_rand(&t->rand), start;
+		size_t f = r % fb.nwork;
+		fb_entry *e = &fb.entries[fb.work[f]];
+		off_t off = ((r >> 16) % (e->size / FB_RANDOM_READ)) * FB_RANDOM_READ;
+		start = fb_now();
+		if (lseek(fds[f], off, SEEK_SET) == -1
+				|| read(fds[f], t->buf, FB_RANDOM_READ) == -1)
+			die(e->path);
+		fb_lat(t, start);
+		t->bytes += FB_RANDOM_READ;
+	}
+	for (i = 0; i < fb.nwork; ++i)
+		close(fds[i]);
+	free(fds);
+}
+
+/* Every thread stats everything, in its own order */
+static void fb_stat(fb_thread *t) {
+	size_t i;
+	for (i = 0; i < fb.nwork; ++i) {
+		size_t j = (i + t->id * (fb.nwork / 8 + 1)) % fb.nwork;
+		fb_entry *e = &fb.entries[fb.work[j]];
+		struct stat st;
+		uint64_t start = fb_now();
+		if (lstat(e->path, &st) == -1)
+			die(e->path);
+		fb_lat(t, start);
+	}
+}
+
+/* Each deep path once, so every component needs a lookup */
+static void fb_lookup(fb_thread *t) {
+	fb_entry *e;
+	while ((e = fb_take())) {
+		struct stat st;
+		uint64_t start = fb_now();
+		if (lstat(e->path, &st) == -1)
+			die(e->path);
+		fb_lat(t, start);
+	}
+}
+
+/* Like find(1): list each directory and stat what's in it. Times each
+ * directory, single-threaded. */
+static void fb_find_dir(fb_thread *t, const char *path) {
+	DIR *d;
+	struct dirent *de;
+	uint64_t start = fb_now();
+	size_t plen = strlen(path);
+	char **subdirs = NULL;
+	size_t nsub = 0, subcap = 0, i;
+
+	if (!(d = opendir(path)))
+		die(path);
+	while ((de = readdir(d))) {
+		struct stat st;
+		size_t nlen = strlen(de->d_name);
+		char *sub;
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		sub = fb_alloc(plen + nlen + 2);
+		memcpy(sub, path, plen);
+		sub[plen] = '/';
+		memcpy(sub + plen + 1, de->d_name, nlen + 1);
+		if (lstat(sub, &st) == -1)
+			die(sub);
+		++t->bytes;				/* Counts entries here */
+		if (S_ISDIR(st.st_mode)) {
+			if (nsub == subcap) {
+				subcap = subcap ? subcap * 2 : 16;
+				if (!(subdirs = realloc(subdirs, subcap * sizeof(*subdirs))))
+					die("malloc");
+			}
+			subdirs[nsub++] = sub;
+		} else {
+			free(sub);
+		}
+	}
+	closedir(d);
+	fb_lat(t, start);
+
+	for (i = 0; i < nsub; ++i) {
+		fb_find_dir(t, subdirs[i]);
+		free(subdirs[i]);
+	}
+	free(subdirs);
+}
+
+static void fb_find(fb_thread *t) {
+	if (t->id == 0)
+		fb_find_dir(t, fb.dir);
+}
+
+static const fb_workload fb_workloads[] = {
+	{ "seq_read", fb_seq_read, "MiB/s" },
+	{ "random_read", fb_random_read, "reads/s" },
+	{ "stat", fb_stat, "stats/s" },
+	{ "find", fb_find, "entries/s" },
+	{ "small_read", fb_small_read, "files/s" },
+	{ "lookup", fb_lookup, "lookups/s" },
+	{ NULL }
+};
+
+static void *fb_run(void *arg) {
+	fb.fn(arg);
+	return NULL;
+}
+
+static int fb_lat_cmp(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static void fb_report(const char *label, const char *name, double value,
+		const char *unit) {
+	printf("%s\t%s\t%.1f\t%s\n", label, name, value, unit);
+}
+
+int main(int argc, char *argv[]) {
+	const char *label = NULL;
+	const fb_workload *w;
+	fb_thread *threads;
+	long nthreads = 1;
+	uint64_t start, elapsed, ops = 0, bytes = 0, *lat;
+	size_t i, nlat = 0;
+	char name[64];
+
+	if (argc == 3 && strcmp(argv[1], "-s") == 0) {
+		fb.dir = argv[2];
+		fb_scan(argv[2], "", 0);
+		if (fflush(stdout))
+			die("write error");
+		return 0;
+	}
+	while (argc > 1 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-j") == 0 && argc > 2) {
+			if ((nthreads = atol(argv[2])) < 1)
+				usage();
+		} else if (strcmp(argv[1], "-n") == 0 && argc > 2) {
+			label = argv[2];
+		} else {
+			usage();
+		}
+		argv += 2;
+		argc -= 2;
+	}
+#ifndef HAVE_PTHREAD
+	nthreads = 1;
+#endif
+	if (argc != 4)
+		usage();
+	for (w = fb_workloads; w->name && strcmp(w->name, argv[1]) != 0; ++w)
+		;
+	if (!w->name)
+		usage();
+	if (!label)
+		label = argv[2];
+	fb.dir = argv[2];
+	fb_read_list(argv[3]);
+
+	if (w->fn == fb_seq_read || w->fn == fb_random_read)
+		fb_select(fb_want_large);
+	else if (w->fn == fb_small_read)
+		fb_select(fb_want_small);
+	else if (w->fn == fb_lookup)
+		fb_select(fb_want_deep);
+	else
+		fb_select(fb_want_any);
+
+	fb.reads = FB_RANDOM_READS / nthreads + 1;
+	fb.fn = w->fn;
+	if (!(threads = calloc(nthreads, sizeof(*threads))))
+		die("malloc");
+	for (i = 0; i < (size_t)nthreads; ++i) {
+		threads[i].id = i;
+		threads[i].rand = 0x9e3779b97f4a7c15ULL + i;
+		threads[i].buf = fb_alloc(FB_READ_CHUNK);
+	}
+
+	start = fb_now();
+#ifdef HAVE_PTHREAD
+	for (i = 1; i < (size_t)nthreads; ++i) {
+		if (pthread_create(&threads[i].thread, NULL, fb_run, &threads[i]))
+			die("pthread_create");
+	}
+#endif
+	fb_run(&threads[0]);
+#ifdef HAVE_PTHREAD
+	for (i = 1; i < (size_t)nthreads; ++i)
+		pthread_join(threads[i].thread, NULL);
+#endif
+	elapsed = fb_now() - start;
+
+	for (i = 0; i < (size_t)nthreads; ++i) {
+		ops += threads[i].nlat;
+		bytes += threads[i].bytes;
+	}
+	lat = fb_alloc((ops + 1) * sizeof(*lat));
+	for (i = 0; i < (size_t)nthreads; ++i) {
+		memcpy(lat + nlat, threads[i].lat, threads[i].nlat * sizeof(*lat));
+		nlat += threads[i].nlat;
+	}
+	if (nlat == 0) {
+		fprintf(stderr, "%s: nothing to do for %s\n", PROGNAME, w->name);
+		return 1;
+	}
+	qsort(lat, nlat, sizeof(*lat), fb_lat_cmp);
+
+	if (w->fn == fb_seq_read)
+		fb_report(label, w->name, bytes * 1e9 / elapsed / (1024 * 1024), w->unit);
+	else if (w->fn == fb_find)
+		fb_report(label, w->name, bytes * 1e9 / elapsed, w->unit);
+	else
+		fb_report(label, w->name, ops * 1e9 / elapsed, w->unit);
+	snprintf(name, sizeof(name), "%s_p50", w->name);
+	fb_report(label, name, lat[nlat / 2] / 1000.0, "us");
+	snprintf(name, sizeof(name), "%s_p99", w->name);
+	fb_report(label, name, lat[nlat * 99 / 100] / 1000.0, "us");
+	return 0;
+}
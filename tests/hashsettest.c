@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "hashset.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Check the hashset against a list of the keys added: duplicates, growth
+ * past the load limit, and keys too big to share an arena chunk. */
+
+#define KEYS 5000
+
+static void fail(const char *what, const char *key) {
+	fprintf(stderr, "%s: %.40s\n", what, key);
+	exit(1);
+}
+
+static char *key_of(size_t i) {
+	static char buf[64];
+	snprintf(buf, sizeof(buf), "key-%lu", (unsigned long)i);
+	return buf;
+}
+
+static void check_load(hashset *m) {
+	if (m->nkeys * 4 > m->nslots * 3)
+		fail("Table too full", "");
+}
+
+static void duplicates(void) {
+	hashset m;
+	hashset_init(&m);
+	if (hashset_getlevel(&m, "a") != -1)
+		fail("Found a key in an empty set", "a");
+	if (hashset_add(&m, "a", 1) != 1 || hashset_add(&m, "b", 2) != 2)
+		fail("Add failed", "a");
+	if (hashset_add(&m, "a", 3) != 1)
+		fail("Duplicate didn't return the first level", "a");
+	if (m.nkeys != 2 || hashset_getlevel(&m, "a") != 1)
+		fail("Duplicate changed the set", "a");
+	if (hashset_getlevel(&m, "") != -1 || hashset_add(&m, "", 4) != 4
+			|| hashset_getlevel(&m, "") != 4)
+		fail("Empty key", "");
+	hashset_free(&m);
+	if (m.nkeys != 0 || hashset_getlevel(&m, "a") != -1)
+		fail("Free didn't empty the set", "a");
+}
+
+static void growth(void) {
+	hashset m;
+	size_t i;
+	unsigned first;
+
+	hashset_init(&m);
+	hashset_add(&m, key_of(0), 0);
+	first = m.nslots;
+	for (i = 1; i < KEYS; ++i) {
+		if (hashset_add(&m, key_of(i), (int)(i % 7)) != (int)(i % 7))
+			fail("Add failed", key_of(i));
+		check_load(&m);
+	}
+	if (m.nkeys != KEYS || m.nslots <= first)
+		fail("Table didn't grow", "");
+	for (i = 0; i < KEYS; ++i) {
+		if (hashset_getlevel(&m, key_of(i)) != (int)(i % 7))
+			fail("Wrong level", key_of(i));
+		if (hashset_add(&m, key_of(i), 9) != (int)(i % 7))
+			fail("Duplicate after growing", key_of(i));
+	}
+	for (i = KEYS; i < 2 * KEYS; ++i) {
+		if (hashset_getlevel(&m, key_of(i)) != -1)
+			fail("Found a key never added", key_of(i));
+	}
+	hashset_free(&m);
+}
+
+/* Keys around and beyond the arena chunk sizes, which need chunks of their
+ * own, mixed with small keys that fill in chunks */
+static void big_keys(void) {
+	static const size_t sizes[] = { 3000, 4095, 4096, 5000, 100000,
+		300000, 1 };
+	size_t nsizes = sizeof(sizes) / sizeof(*sizes), i, j;
+	char *keys[2 * (sizeof(sizes) / sizeof(*sizes))];
+	hashset m;
+
+	hashset_init(&m);
+	for (i = 0; i < nsizes; ++i) {
+		for (j = 0; j < 2; ++j) {
+			char *k = malloc(sizes[i] + 1);
+			if (!k)
+				fail("malloc", "");
+			memset(k, 'a' + (int)j, sizes[i]);
+			k[sizes[i]] = '\0';
+			keys[2 * i + j] = k;
+			if (hashset_add(&m, k, (int)(2 * i + j)) != (int)(2 * i + j))
+				fail("Add failed", k);
+			hashset_add(&m, key_of(2 * i + j), -2);
+		}
+	}
+	for (i = 0; i < 2 * nsizes; ++i) {
+		if (hashset_getlevel(&m, keys[i]) != (int)i)
+			fail("Wrong level", keys[i]);
+		if (hashset_getlevel(&m, key_of(i)) != -2)
+			fail("Wrong level", key_of(i));
+	}
+	/* A prefix of a stored key isn't in the set */
+	keys[0][sizes[0] - 1] = '\0';
+	if (hashset_getlevel(&m, keys[0]) != -1)
+		fail("Found a prefix", keys[0]);
+	hashset_free(&m);
+	for (i = 0; i < 2 * nsizes; ++i)
+		free(keys[i]);
+}
+
+int main(void) {
+	duplicates();
+	growth();
+	big_keys();
+	return 0;
+}
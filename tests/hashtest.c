@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Check sqfs_hash against a plain array, through random inserts, lookups and
+ * removals that make the table grow several times, and some removals placed
+ * to hit the edge cases of backward-shift deletion. */
+
+#define KEYS 4096
+
+typedef struct {
+	sqfs_hash_key key;
+	uint32_t serial;
+	char pad[5];		/* An odd size, to check slot alignment */
+} value;
+
+static value ref[KEYS];
+static int present[KEYS];
+static size_t count;
+static uint32_t serial;
+static uint64_t rng = 88172645463325252ULL;
+
+static uint32_t rnd(void) {
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return (uint32_t)(rng >> 32);
+}
+
+/* Spread keys out, so some are large */
+static sqfs_hash_key key_of(size_t i) {
+	return (sqfs_hash_key)(i * 2654435761u);
+}
+
+/* The slot a key hashes to, the same way sqfs_hash does */
+static size_t home_of(sqfs_hash *h, sqfs_hash_key k) {
+	return (size_t)(((uint64_t)k * 0x9e3779b97f4a7c15ULL) >> h->shift);
+}
+
+static void fail(const char *what, sqfs_hash_key k) {
+	fprintf(stderr, "%s, key %lu\n", what, (unsigned long)k);
+	exit(1);
+}
+
+static void check_all(sqfs_hash *h) {
+	size_t i;
+	if (h->size != count)
+		fail("Wrong size", 0);
+	for (i = 0; i < KEYS; ++i) {
+		value *v = sqfs_hash_get(h, key_of(i));
+		if (!present[i] != !v)
+			fail(present[i] ? "Missing key" : "Unexpected key", key_of(i));
+		if (v && memcmp(v, &ref[i], sizeof(*v)) != 0)
+			fail("Wrong value", key_of(i));
+	}
+}
+
+static void add(sqfs_hash *h, size_t i) {
+	ref[i].key = key_of(i);
+	ref[i].serial = ++serial;
+	if (sqfs_hash_add(h, key_of(i), &ref[i]))
+		fail("Add failed", key_of(i));
+	if (!present[i])
+		++count;
+	present[i] = 1;
+}
+
+static void del(sqfs_hash *h, size_t i) {
+	if (sqfs_hash_remove(h, key_of(i)))
+		fail("Remove failed", key_of(i));
+	if (present[i])
+		--count;
+	present[i] = 0;
+}
+
+static void random_ops(sqfs_hash *h, size_t ops, size_t range, int adds) {
+	size_t n;
+	for (n = 0; n < ops; ++n) {
+		size_t i = rnd() % range;
+		if ((int)(rnd() % 100) < adds)
+			add(h, i);
+		else
+			del(h, i);
+		if (n % 64 == 0)
+			check_all(h);
+	}
+	check_all(h);
+}
+
+/* Fill a small table with a run of keys that share the last slot as home,
+ * so the run wraps around to the start, then remove from the middle and
+ * ends of the run */
+static void wrap_run(void) {
+	sqfs_hash h;
+	size_t run[5], found = 0, i;
+
+	memset(present, 0, sizeof(present));
+	count = 0;
+	if (sqfs_hash_init(&h, sizeof(value), 16))
+		fail("Init failed", 0);
+	for (i = 0; i < KEYS && found < 5; ++i) {
+		if (home_of(&h, key_of(i)) == h.capacity - 1)
+			run[found++] = i;
+	}
+	if (found < 5)
+		fail("Not enough colliding keys", 0);
+
+	/* Keys whose home is slot 0, behind the run */
+	for (i = 0; i < KEYS && count < 2; ++i) {
+		if (home_of(&h, key_of(i)) == 0)
+			add(&h, i);
+	}
+	for (i = 0; i < 5; ++i)
+		add(&h, run[i]);
+	if (h.capacity != 16)
+		fail("Table grew too early", 0);
+	check_all(&h);
+
+	del(&h, run[2]);
+	check_all(&h);
+	del(&h, run[0]);
+	check_all(&h);
+	add(&h, run[2]);
+	check_all(&h);
+	del(&h, run[4]);
+	check_all(&h);
+	add(&h, run[0]);
+	add(&h, run[4]);
+	check_all(&h);
+	for (i = 0; i < 5; ++i) {
+		del(&h, run[i]);
+		check_all(&h);
+	}
+	sqfs_hash_destroy(&h);
+}
+
+int main(void) {
+	sqfs_hash h;
+
+	wrap_run();
+
+	memset(present, 0, sizeof(present));
+	count = 0;
+	if (sqfs_hash_init(&h, sizeof(value), 8))
+		fail("Init failed", 0);
+	random_ops(&h, 20000, KEYS, 75);	/* Mostly growing */
+	if (h.capacity < KEYS / 2)
+		fail("Table didn't grow", 0);
+	random_ops(&h, 20000, KEYS, 50);
+	random_ops(&h, 20000, KEYS, 20);	/* Mostly shrinking */
+	random_ops(&h, 20000, 64, 50);		/* Dense in a few keys */
+	sqfs_hash_destroy(&h);
+	return 0;
+}
@@ -21,6 +21,20 @@ head -c 100 /dev/urandom >"$WORKDIR/source/rand1"
 head -c 17000 /dev/urandom >"$WORKDIR/source/rand2"
 head -c 100 /dev/urandom >"$WORKDIR/source/rand3"
 head -c 87 /dev/zero >"$WORKDIR/source/z1 with spaces"
+printf x >"$WORKDIR/source/q\"uote"
+ln -s rand2 "$WORKDIR/source/link"
+# Sibling subtrees, to check paths as a traversal goes back up and down
+mkdir -p "$WORKDIR/source/dir/sub1/deep" "$WORKDIR/source/dir/sub2/deep"
+printf a >"$WORKDIR/source/dir/sub1/deep/file"
+printf b >"$WORKDIR/source/dir/sub2/deep/file"
+printf c >"$WORKDIR/source/dir/sub2/other"
+: >"$WORKDIR/source/dir/last"
+# Directories whose names share a long prefix
+long=directory_with_a_rather_long_name_to_share
+mkdir -p "$WORKDIR/source/$long/inner" "$WORKDIR/source/${long}_more/inner"
+printf d >"$WORKDIR/source/$long/inner/file"
+printf e >"$WORKDIR/source/${long}_more/inner/file"
+printf f >"$WORKDIR/source/${long}_more/file"
 
 (cd "$WORKDIR/source" && find .) | sed -e 's,^\./,,' | grep -v '^\.$' | sort > "$WORKDIR/files"
 
@@ -34,6 +48,31 @@ for comp in $compressors; do
         exit 1
     fi
 
+    ./squashfuse_ls -0 "$WORKDIR/squashfs.image" | tr '\0' '\n' | sort > "$WORKDIR/ls"
+    if ! diff -u "$WORKDIR/files" "$WORKDIR/ls" ; then
+        echo "Found differing files with -0!"
+        exit 1
+    fi
+
+    if [ "$(./squashfuse_ls -l "$WORKDIR/squashfs.image" | wc -l)" -ne \
+            "$(wc -l < "$WORKDIR/files")" ] ; then
+        echo "Long listing has the wrong number of entries!"
+        exit 1
+    fi
+
+    ./squashfuse_ls -j "$WORKDIR/squashfs.image" > "$WORKDIR/json"
+    if ! grep '^{"path":"rand2","type":"file",.*"size":17000,.*"start_block":' \
+                "$WORKDIR/json" >/dev/null \
+            || ! grep -F '{"path":"q\"uote",' "$WORKDIR/json" >/dev/null \
+            || ! grep -F '{"path":"dir/sub2/deep/file",' "$WORKDIR/json" \
+                >/dev/null \
+            || ! grep -F '"type":"symlink",' "$WORKDIR/json" \
+                | grep -F '"target":"rand2"}' >/dev/null ; then
+        echo "JSON listing is wrong!"
+        cat "$WORKDIR/json"
+        exit 1
+    fi
+
     rm -f "$WORKDIR/squashfs.image"
 done
 
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/* Print where lseek(2) finds data and holes in a file, for tests/ll-smoke.sh.
+ *
+ * Usage: seektest FILE OFFSET...
+ *
+ * For each offset prints "OFFSET DATA HOLE", the results of SEEK_DATA and
+ * SEEK_HOLE from there, with ENXIO in place of an offset when there's
+ * nothing to find. Exits with 77 where SEEK_DATA isn't available.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef SEEK_DATA
+
+static int print_seek(int fd, off_t off, int whence) {
+	off_t pos = lseek(fd, off, whence);
+	if (pos != -1) {
+		printf(" %lld", (long long)pos);
+		return 0;
+	}
+	if (errno == ENXIO) {
+		printf(" ENXIO");
+		return 0;
+	}
+	perror("lseek");
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	int fd, i;
+
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s FILE OFFSET...\n", argv[0]);
+		return 2;
+	}
+
+	if ((fd = open(argv[1], O_RDONLY)) == -1) {
+		perror(argv[1]);
+		return 1;
+	}
+	for (i = 2; i < argc; ++i) {
+		off_t off = strtoll(argv[i], NULL, 10);
+		printf("%lld", (long long)off);
+		if (print_seek(fd, off, SEEK_DATA) || print_seek(fd, off, SEEK_HOLE))
+			return 1;
+		printf("\n");
+	}
+	close(fd);
+	return 0;
+}
+
+#else /* SEEK_DATA */
+
+int main(void) {
+	return 77;
+}
+
+#endif
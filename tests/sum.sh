@@ -0,0 +1,80 @@
+#!/bin/sh
+
+. "tests/lib.sh"
+
+# Check squashfuse_sum against sha256sum run over the source tree, and that
+# -c notices a file that doesn't match its manifest.
+
+trap cleanup EXIT
+set -e
+
+WORKDIR=$(mktemp -d)
+
+cleanup() {
+    set +e # Don't care about errors here.
+    if [ -n "$WORKDIR" ]; then
+        rm -rf "$WORKDIR"
+    fi
+}
+
+if ! command -v sha256sum >/dev/null; then
+    echo "No sha256sum, skipping."
+    exit 77
+fi
+
+find_compressors
+
+mkdir -p "$WORKDIR/source/dir/sub"
+head -c 300000 /dev/urandom >"$WORKDIR/source/rand1"
+head -c 100 /dev/urandom >"$WORKDIR/source/dir/rand2"
+head -c 17000 /dev/urandom >"$WORKDIR/source/dir/sub/rand3"
+head -c 87 /dev/zero >"$WORKDIR/source/z1 with spaces"
+: >"$WORKDIR/source/dir/empty"
+ln -s rand1 "$WORKDIR/source/link"
+
+# sha256sum of each regular file, in the same order squashfuse_sum uses
+(cd "$WORKDIR/source" && find . -type f) | LC_ALL=C sort |
+    while read -r f; do
+        (cd "$WORKDIR/source" && sha256sum "$f")
+    done > "$WORKDIR/manifest"
+sed -e 's,  \./,  ,' "$WORKDIR/manifest" > "$WORKDIR/expected"
+
+for comp in $compressors; do
+    echo "Building $comp squashfs image..."
+    mksquashfs "$WORKDIR/source" "$WORKDIR/squashfs.image" -comp $comp \
+        -no-progress >/dev/null
+
+    for threads in 1 4; do
+        ./squashfuse_sum -j $threads "$WORKDIR/squashfs.image" \
+            > "$WORKDIR/sums"
+        if ! diff -u "$WORKDIR/expected" "$WORKDIR/sums"; then
+            echo "Checksums differ from sha256sum with $threads threads!"
+            exit 1
+        fi
+    done
+
+    # Paths in the manifest start with "./", like find's output
+    if ! ./squashfuse_sum -c "$WORKDIR/manifest" "$WORKDIR/squashfs.image"; then
+        echo "Checking a good manifest failed!"
+        exit 1
+    fi
+
+    zeros=$(printf '%064d' 0)
+    sed -e "/dir\/rand2\$/s/^[0-9a-f]*/$zeros/" "$WORKDIR/manifest" \
+        > "$WORKDIR/bad"
+    if ./squashfuse_sum -c "$WORKDIR/bad" "$WORKDIR/squashfs.image" \
+            > "$WORKDIR/check"; then
+        echo "Checking a bad manifest succeeded!"
+        exit 1
+    fi
+    if ! grep -F 'dir/rand2: FAILED' "$WORKDIR/check" >/dev/null; then
+        echo "Checking a bad manifest didn't report the bad file!"
+        cat "$WORKDIR/check"
+        exit 1
+    fi
+
+    rm -f "$WORKDIR/squashfs.image"
+done
+
+echo "Success."
+exit 0
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2026 Dave Vasilevsky <dave@vasilevsky.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SQFS_TRACE_H
+#define SQFS_TRACE_H
+
+#include "common.h"
+
+/* Static tracepoints, for finding where the time goes on a live mount.
+ *
+ * When built with --enable-tracing, each is a USDT probe in the "squashfuse"
+ * provider. An unused probe is a single nop, and bpftrace, perf or SystemTap
+ * can attach to it in a running process, eg:
+ *
+ *	bpftrace -e 'usdt:./squashfuse_ll:squashfuse:decompress__done
+ *		{ @in = hist(arg0); }'
+ *
+ * Otherwise they compile to nothing, and their arguments aren't evaluated.
+ *
+ * Probes, with their arguments
+ *	op__start		op name (string), op number
+ *	op__done		op name (string), op number, nanoseconds
+ *	md__read__start		block position, offset in block, size
+ *	md__read__done		block position, offset in block, error
+ *	block__read__start	position, size on disk, compressed (0 or 1)
+ *	block__read__done	position, decompressed size, error
+ *	decompress__start	compressed size
+ *	decompress__done	compressed size, decompressed size, error
+ *	pread__start		offset, size
+ *	pread__done		offset, bytes read or -1
+ */
+
+#ifdef ENABLE_TRACING
+	#include <sys/sdt.h>
+	#define SQFS_TRACE1(name, a) \
+		DTRACE_PROBE1(squashfuse, name, a)
+	#define SQFS_TRACE2(name, a, b) \
+		DTRACE_PROBE2(squashfuse, name, a, b)
+	#define SQFS_TRACE3(name, a, b, c) \
+		DTRACE_PROBE3(squashfuse, name, a, b, c)
+#else
+	#define SQFS_TRACE1(name, a) do { } while (0)
+	#define SQFS_TRACE2(name, a, b) do { } while (0)
+	#define SQFS_TRACE3(name, a, b, c) do { } while (0)
+#endif
+
+#endif
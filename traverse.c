@@ -56,11 +56,20 @@ enum {
 typedef struct {
 	sqfs_dir dir;
 	size_t name_size;
+	
+	/* Only for lazy traversals */
+	sqfs_dir_listing listing;
+	const char *name;
+	sqfs_inode_id inode;
+	size_t path_size;		/* Size of trv.path once it ends with our name */
 } sqfs_traverse_level;
 
 
 /* Make our structure safe */
 static void sqfs_traverse_init(sqfs_traverse *trv);
+static sqfs_err sqfs_traverse_start(sqfs_traverse *trv, sqfs *fs,
+	sqfs_inode *inode, sqfs_inode_id iid, bool lazy);
+static void sqfs_traverse_level_free(void *v);
 
 /* Path manipulation functions */
 static sqfs_err sqfs_traverse_path_init(sqfs_traverse *trv);
@@ -78,7 +87,7 @@ static void sqfs_traverse_path_terminate(sqfs_traverse *trv);
 
 /* Descend into new directories, and ascend back */
 static sqfs_err sqfs_traverse_descend_inode(sqfs_traverse *trv,
-	sqfs_inode *inode);
+	sqfs_inode *inode, sqfs_inode_id iid);
 static sqfs_err sqfs_traverse_descend(sqfs_traverse *trv, sqfs_inode_id iid);
 static sqfs_err sqfs_traverse_ascend(sqfs_traverse *trv);
 
@@ -88,21 +97,32 @@ static void sqfs_traverse_init(sqfs_traverse *trv) {
 	sqfs_stack_init(&trv->stack);
 	trv->state = TRAVERSE_ERROR;
 	trv->path = NULL;
+	trv->name = NULL;
+	trv->name_size = 0;
+	trv->lazy = false;
+	trv->path_dirs = 0;
 }
 
-sqfs_err sqfs_traverse_open_inode(sqfs_traverse *trv, sqfs *fs,
-		sqfs_inode *inode) {
+static void sqfs_traverse_level_free(void *v) {
+	sqfs_traverse_level *level = v;
+	sqfs_dir_listing_close(&level->listing);
+}
+
+static sqfs_err sqfs_traverse_start(sqfs_traverse *trv, sqfs *fs,
+		sqfs_inode *inode, sqfs_inode_id iid, bool lazy) {
 	sqfs_err err;
 	
 	sqfs_traverse_init(trv);	
 	if ((err = sqfs_traverse_path_init(trv)))
 		goto error;
-	err = sqfs_stack_create(&trv->stack, sizeof(sqfs_traverse_level), 0, NULL);
+	err = sqfs_stack_create(&trv->stack, sizeof(sqfs_traverse_level), 0,
+		sqfs_traverse_level_free);
 	if (err)
 		goto error;
 	
 	trv->fs = fs;
-	if ((err = sqfs_traverse_descend_inode(trv, inode)))
+	trv->lazy = lazy;
+	if ((err = sqfs_traverse_descend_inode(trv, inode, iid)))
 		goto error;
 	
 	sqfs_traverse_path_set_name_size(trv, 0); /* The root has no name */
@@ -114,6 +134,11 @@ error:
 	return err;
 }
 
+sqfs_err sqfs_traverse_open_inode(sqfs_traverse *trv, sqfs *fs,
+		sqfs_inode *inode) {
+	return sqfs_traverse_start(trv, fs, inode, 0, false);
+}
+
 sqfs_err sqfs_traverse_open(sqfs_traverse *trv, sqfs *fs, sqfs_inode_id iid) {
 	sqfs_err err;
 	sqfs_inode inode;
@@ -124,6 +149,17 @@ sqfs_err sqfs_traverse_open(sqfs_traverse *trv, sqfs *fs, sqfs_inode_id iid) {
 	return sqfs_traverse_open_inode(trv, fs, &inode);
 }
 
+sqfs_err sqfs_traverse_open_lazy(sqfs_traverse *trv, sqfs *fs,
+		sqfs_inode_id iid) {
+	sqfs_err err;
+	sqfs_inode inode;
+	
+	if ((err = sqfs_inode_get(fs, &inode, iid)))
+		return err;
+	
+	return sqfs_traverse_start(trv, fs, &inode, iid, true);
+}
+
 void sqfs_traverse_close(sqfs_traverse *trv) {
 	sqfs_stack_destroy(&trv->stack);
 	free(trv->path);
@@ -142,7 +178,14 @@ bool sqfs_traverse_next(sqfs_traverse *trv, sqfs_err *err) {
 				if ((*err = sqfs_stack_top(&trv->stack, &level)))
 					goto error;
 				
-				found = sqfs_dir_next(trv->fs, &level->dir, &trv->entry, err);
+				if (trv->lazy) {
+					found = sqfs_dir_listing_next(&level->listing, &trv->entry,
+						&trv->name, err);
+					trv->name_size = sqfs_dentry_name_size(&trv->entry);
+					trv->parent = level->inode;
+				} else {
+					found = sqfs_dir_next(trv->fs, &level->dir, &trv->entry, err);
+				}
 				if (*err)
 					goto error;
 				if (found)
@@ -152,7 +195,7 @@ bool sqfs_traverse_next(sqfs_traverse *trv, sqfs_err *err) {
 				break;
 			
 			case TRAVERSE_NAME_ADD:
-				if ((*err = sqfs_traverse_path_add_name(trv)))
+				if (!trv->lazy && (*err = sqfs_traverse_path_add_name(trv)))
 					goto error;
 				if (sqfs_dentry_is_dir(&trv->entry))
 					trv->state = TRAVERSE_DESCEND;
@@ -162,7 +205,8 @@ bool sqfs_traverse_next(sqfs_traverse *trv, sqfs_err *err) {
 				return true;
 			
 			case TRAVERSE_NAME_REMOVE:
-				sqfs_traverse_path_remove_name(trv);
+				if (!trv->lazy)
+					sqfs_traverse_path_remove_name(trv);
 				trv->state = TRAVERSE_GET_ENTRY;
 				break;
 			
@@ -203,6 +247,44 @@ sqfs_err sqfs_traverse_prune(sqfs_traverse *trv) {
 	return SQFS_OK;
 }
 
+sqfs_err sqfs_traverse_path(sqfs_traverse *trv, const char **path) {
+	sqfs_err err;
+	sqfs_traverse_level *level;
+	size_t depth, i;
+	
+	if (trv->lazy) {
+		/* Keep the part of the path for directories we already added, and
+		   add any directories entered since. Their names are still in their
+		   parents' listings, and the root has none. */
+		depth = sqfs_stack_size(&trv->stack);
+		trv->path_size = 1;
+		if (trv->path_dirs > 0) {
+			if ((err = sqfs_stack_at(&trv->stack, trv->path_dirs - 1, &level)))
+				return err;
+			trv->path_size = level->path_size;
+		}
+		for (i = trv->path_dirs; i < depth; ++i) {
+			if ((err = sqfs_stack_at(&trv->stack, i, &level)))
+				return err;
+			if (i > 0) {
+				if ((err = sqfs_traverse_path_add(trv, level->name, level->name_size)))
+					return err;
+				if ((err = sqfs_traverse_path_add_sep(trv)))
+					return err;
+			}
+			level->path_size = trv->path_size;
+		}
+		trv->path_dirs = depth;
+		
+		sqfs_traverse_path_terminate(trv);
+		if ((err = sqfs_traverse_path_add(trv, trv->name, trv->name_size)))
+			return err;
+	}
+	
+	*path = trv->path;
+	return SQFS_OK;
+}
+
 
 static sqfs_err sqfs_traverse_path_init(sqfs_traverse *trv) {
 	trv->path_cap = TRAVERSE_DEFAULT_PATH_CAP;
@@ -273,7 +355,7 @@ static void sqfs_traverse_path_set_name_size(sqfs_traverse *trv, size_t size) {
 
 
 static sqfs_err sqfs_traverse_descend_inode(sqfs_traverse *trv,
-		sqfs_inode *inode) {
+		sqfs_inode *inode, sqfs_inode_id iid) {
 	sqfs_err err;
 	sqfs_traverse_level *level;
 	bool initial;
@@ -282,6 +364,15 @@ static sqfs_err sqfs_traverse_descend_inode(sqfs_traverse *trv,
 	
 	if ((err = sqfs_stack_push(&trv->stack, &level)))
 		return err;	
+	memset(level, 0, sizeof(*level));
+	
+	if (trv->lazy) {
+		level->inode = iid;
+		level->name = trv->name;
+		level->name_size = trv->name_size;
+		return sqfs_dir_listing_open(trv->fs, inode, &level->listing);
+	}
+	
 	if ((err = sqfs_dir_open(trv->fs, inode, &level->dir, 0)))
 		return err;
 	
@@ -304,7 +395,7 @@ static sqfs_err sqfs_traverse_descend(sqfs_traverse *trv, sqfs_inode_id iid) {
 	if ((err = sqfs_inode_get(trv->fs, &inode, iid)))
 		return err;
 	
-	return sqfs_traverse_descend_inode(trv, &inode);
+	return sqfs_traverse_descend_inode(trv, &inode, iid);
 }
 
 static sqfs_err sqfs_traverse_ascend(sqfs_traverse *trv) {
@@ -314,9 +405,22 @@ static sqfs_err sqfs_traverse_ascend(sqfs_traverse *trv) {
 	if ((err = sqfs_stack_top(&trv->stack, &level)))
 		return err;
 	
-	sqfs_traverse_path_remove_sep(trv); /* safe even if initial */
-	sqfs_traverse_path_set_name_size(trv, level->name_size);
+	if (trv->lazy) {
+		/* Report the finished directory, its name is in the parent's listing */
+		trv->name = level->name;
+		trv->name_size = level->name_size;
+	} else {
+		sqfs_traverse_path_remove_sep(trv); /* safe even if initial */
+		sqfs_traverse_path_set_name_size(trv, level->name_size);
+	}
 	
 	sqfs_stack_pop(&trv->stack);
+	if (trv->path_dirs > sqfs_stack_size(&trv->stack))
+		trv->path_dirs = sqfs_stack_size(&trv->stack);
+	if (trv->lazy && sqfs_stack_size(&trv->stack) > 0) {
+		if ((err = sqfs_stack_top(&trv->stack, &level)))
+			return err;
+		trv->parent = level->inode;
+	}
 	return SQFS_OK;
 }
@@ -35,15 +35,23 @@ typedef struct {
 	sqfs_dir_entry entry;
 	char *path;
 	
+	/* Only with sqfs_traverse_open_lazy. When dir_end is true, these describe
+	   the directory that's finished. */
+	const char *name;				/* NOT nul-terminated */
+	size_t name_size;
+	sqfs_inode_id parent;		/* The directory containing this entry */
+	
 	
 	/* private */
 	int state;	
+	bool lazy;
 	sqfs *fs;
 	sqfs_name namebuf;
 	sqfs_stack stack;
 	
 	size_t path_size, path_cap;
 	size_t path_last_size;
+	size_t path_dirs;		/* Levels whose names are in path, when lazy */
 } sqfs_traverse;
 
 /* Begin a recursive traversal of a filesystem tree.
@@ -53,6 +61,19 @@ sqfs_err sqfs_traverse_open(sqfs_traverse *trv, sqfs *fs, sqfs_inode_id iid);
 sqfs_err sqfs_traverse_open_inode(sqfs_traverse *trv, sqfs *fs,
 	sqfs_inode *inode);
 
+/* Like sqfs_traverse_open, but faster for large trees: the path isn't built
+   as we go, and entry names aren't copied. Instead, each item sets trv->name
+   to point into the directory listing, and trv->parent to the directory's
+   inode. The name stays valid until the traversal leaves that directory.
+   Use sqfs_traverse_path to get a full path only when you need it. */
+sqfs_err sqfs_traverse_open_lazy(sqfs_traverse *trv, sqfs *fs,
+	sqfs_inode_id iid);
+
+/* Get the path of the current item. After sqfs_traverse_open_lazy this builds
+   it on demand, otherwise it's just trv->path. Valid until the next call to
+   sqfs_traverse_next. */
+sqfs_err sqfs_traverse_path(sqfs_traverse *trv, const char **path);
+
 /* Clean up at any point during or after a traversal */
 void sqfs_traverse_close(sqfs_traverse *trv);
 
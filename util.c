@@ -50,6 +50,7 @@
 		CloseHandle(fd);
 	}
 #else
+	#include <errno.h>
 	#include <fcntl.h>
 	#include <unistd.h>
 
@@ -66,6 +67,29 @@
 	void sqfs_fd_close(sqfs_fd_t fd) {
 		close(fd);
 	}
+
+	char *sqfs_abs_path(const char *path) {
+		char *cwd, *abs;
+		size_t size = 256;
+		
+		if (path[0] == '/')
+			return strdup(path);
+		
+		while (true) {
+			if (!(cwd = malloc(size)))
+				return NULL;
+			if (getcwd(cwd, size))
+				break;
+			free(cwd);
+			if (errno != ERANGE)
+				return NULL;
+			size *= 2;
+		}
+		if ((abs = malloc(strlen(cwd) + 1 + strlen(path) + 1)))
+			sprintf(abs, "%s/%s", cwd, path);
+		free(cwd);
+		return abs;
+	}
 #endif
 
 
@@ -35,6 +35,10 @@ sqfs_err sqfs_fd_open(const char *path, sqfs_fd_t *fd, bool print);
 /* Close a file */
 void sqfs_fd_close(sqfs_fd_t fd);
 
+/* A malloc'd absolute version of 'path', which need not exist yet, so it
+   still works after daemonizing changes to the root directory */
+char *sqfs_abs_path(const char *path);
+
 /* Open a filesystem and print errors to stderr. */
 sqfs_err sqfs_open_image(sqfs *fs, const char *image, size_t offset);
 